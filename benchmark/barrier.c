@@ -0,0 +1,143 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pcontainer.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+int devfd;
+int gang = 0;
+int tasks = 4;
+int steps = 1000;
+volatile long long sink;
+
+struct group
+{
+    int cid;
+    pthread_barrier_t barrier;
+    long long last;     // end of the previous step
+    long long *step_ns; // length of every step
+};
+
+/**
+ * monotonic clock in nanoseconds.
+ */
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int cmp_ll(const void *a, const void *b)
+{
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Joins its container and runs a number of steps, each a little work
+ * followed by a barrier with the other members. The last task to reach
+ * the barrier records how long the step took.
+ */
+void *thread_body(void *x)
+{
+    struct group *g = (struct group *)x;
+    long long t;
+    int i, j;
+
+    pcontainer_create(devfd, g->cid);
+    if (gang)
+        pcontainer_set_gang(devfd, g->cid, 1);
+    // start measuring once everybody joined
+    if (pthread_barrier_wait(&g->barrier) == PTHREAD_BARRIER_SERIAL_THREAD)
+        g->last = now_ns();
+    for (i = 0; i < steps; i++)
+    {
+        for (j = 0; j < 10000; j++)
+            sink += j;
+        if (pthread_barrier_wait(&g->barrier) == PTHREAD_BARRIER_SERIAL_THREAD)
+        {
+            t = now_ns();
+            g->step_ns[i] = t - g->last;
+            g->last = t;
+        }
+    }
+    pcontainer_delete(devfd, g->cid);
+    return NULL;
+}
+
+/**
+ * usage: ./barrier [rr|gang] [containers] [tasks] [steps]
+ *
+ * Runs barrier-synchronized task groups, one per container, and reports
+ * the mean, median and 99th percentile step length of all groups, either
+ * with the members rotated round robin or with the containers in gang mode.
+ */
+int main(int argc, char *argv[])
+{
+    int i, containers = 2, n;
+    long long start, elapsed, *all;
+    double mean = 0;
+    struct group *groups;
+    pthread_t *threads;
+
+    if (argc > 1)
+        gang = strcmp(argv[1], "gang") == 0;
+    if (argc > 2)
+        containers = atoi(argv[2]);
+    if (argc > 3)
+        tasks = atoi(argv[3]);
+    if (argc > 4)
+        steps = atoi(argv[4]);
+
+    devfd = pcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed\n");
+        exit(1);
+    }
+    pcontainer_init(devfd);
+
+    groups = (struct group *) calloc(containers, sizeof(struct group));
+    threads = (pthread_t *) calloc(containers * tasks, sizeof(pthread_t));
+    for (i = 0; i < containers; i++)
+    {
+        groups[i].cid = i;
+        groups[i].step_ns = (long long *) calloc(steps, sizeof(long long));
+        pthread_barrier_init(&groups[i].barrier, NULL, tasks);
+    }
+    start = now_ns();
+    for (i = 0; i < containers * tasks; i++)
+        pthread_create(&threads[i], NULL, thread_body, &groups[i % containers]);
+    for (i = 0; i < containers * tasks; i++)
+        pthread_join(threads[i], NULL);
+    elapsed = now_ns() - start;
+
+    n = containers * steps;
+    all = (long long *) calloc(n, sizeof(long long));
+    for (i = 0; i < containers; i++)
+        memcpy(all + i * steps, groups[i].step_ns, steps * sizeof(long long));
+    for (i = 0; i < n; i++)
+        mean += all[i];
+    mean /= n;
+    qsort(all, n, sizeof(long long), cmp_ll);
+
+    printf("%s containers %d tasks %d steps %d mean_us %.1f p50_us %.1f p99_us %.1f elapsed_s %.3f\n",
+           gang ? "gang" : "rr", containers, tasks, steps,
+           mean / 1e3, all[n / 2] / 1e3, all[n * 99 / 100] / 1e3, elapsed / 1e9);
+
+    // cleanup
+    for (i = 0; i < containers; i++)
+    {
+        pthread_barrier_destroy(&groups[i].barrier);
+        free(groups[i].step_ns);
+    }
+    free(groups);
+    free(all);
+    free(threads);
+    close(devfd);
+    return 0;
+}
@@ -7,6 +7,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <sys/time.h>
+#include <sys/resource.h>
 #include <sys/syscall.h>
 #include <sys/mman.h>
 #include <sys/wait.h>
@@ -16,23 +17,35 @@ int devfd;
 pthread_mutex_t mutex;
 int cnt = 0;
 long long total = 0;
+unsigned long long *shares;
+unsigned long long *concurrency;
+int fibers = 0;
+long long yields = 0;
+volatile double sink;
 
 /**
  * Thread body that creates task in a specified container, does some simple calculations
- * and deletes the task in that container.
+ * and deletes the task in that container. In fiber mode it runs as a fiber that
+ * the library adds to the container, and yields to its siblings after each chunk.
  */
 void *thread_body(void *x)
 {
     int processed = 0;
-    int i;
-    double sum;
+    int i, done = 0;
+    double sum = 0;
     int cid = *((int *)x);
 
     // allocate/associate a container for the thread.
-    pcontainer_create(devfd, cid);
-    int ths = cnt++;
-    //while(total < 0)
-    while (total < 500000000)
+    if (!fibers)
+        pcontainer_create(devfd, cid);
+    if (shares[cid])
+        pcontainer_set_shares(devfd, cid, shares[cid]);
+    if (concurrency[cid])
+        pcontainer_set_concurrency(devfd, cid, concurrency[cid]);
+    pthread_mutex_lock(&mutex);
+    cnt++;
+    pthread_mutex_unlock(&mutex);
+    while (!done)
     {
         // calculate some dumb numbers here.
         for (i = 0; i < 1000000; i++)
@@ -44,18 +57,28 @@ void *thread_body(void *x)
         // update the total counter.
         pthread_mutex_lock(&mutex);
             total += 1000000;
+            done = total >= 500000000;
+            if (fibers)
+                yields++;
         pthread_mutex_unlock(&mutex);
+        if (fibers)
+            pcontainer_fiber_yield();
     }
+    // keep the calculation from being optimized away
+    sink = sum;
     // The sum of each container should be close.
     fprintf(stderr, "TID: %d Container: %d Processed: %d\n", (int)syscall(SYS_gettid), cid, processed);
 
     // Delete a container.
-    pcontainer_delete(devfd, cid);
+    if (!fibers)
+        pcontainer_delete(devfd, cid);
     return NULL;
 }
 
 /**
- * main function to create/run/delete threads in different containers 
+ * main function to create/run/delete threads in different containers.
+ * With PCONTAINER_FIBERS set in the environment the tasks are fibers of
+ * libpcontainer instead of threads, one carrier thread per container.
  */
 int main(int argc, char *argv[])
 {
@@ -63,18 +86,22 @@ int main(int argc, char *argv[])
     int total_tasks = 0; 
     int *tasks_in_containers;
     int *cid;
+    char *field;
+    struct timeval start, end;
+    struct rusage usage;
+    double elapsed;
     pthread_t *threads;
 
     // check num of arguments.
     if (argc < 3)
     {
         fprintf(stderr, "Not enough parameters\n");
-        fprintf(stderr, "usage: ./benchmark <num_container> [<num_task_in_container> ...]\n");
+        fprintf(stderr, "usage: ./benchmark <num_container> [<num_task_in_container>[:<shares>[:<concurrency>]] ...]\n");
         exit(1);
     }
     
     // open the kernel module
-    devfd = open("/dev/pcontainer", O_RDWR);
+    devfd = pcontainer_open();
     if (devfd < 0)
     {
         fprintf(stderr, "Device open failed\n");
@@ -89,18 +116,27 @@ int main(int argc, char *argv[])
     if (argc - 2 < num_of_containers)
     {
         fprintf(stderr, "Not enough parameters\n");
-        fprintf(stderr, "usage: ./benchmark <num_container> [<num_task_in_container> ...]\n");
+        fprintf(stderr, "usage: ./benchmark <num_container> [<num_task_in_container>[:<shares>[:<concurrency>]] ...]\n");
         exit(1);
     }
     
     // generate and store number of tasks and cid for each container.
     tasks_in_containers = (int *) calloc(num_of_containers, sizeof(int));
     cid = (int *) calloc(num_of_containers, sizeof(int));
+    shares = (unsigned long long *) calloc(num_of_containers, sizeof(unsigned long long));
+    concurrency = (unsigned long long *) calloc(num_of_containers, sizeof(unsigned long long));
 
     for (i = 0; i < num_of_containers; i++)
     {
         tasks = atoi(argv[i+2]);
-        fprintf(stderr, "task for container %d: %d\n", i, tasks);
+        // optional CPU shares and concurrency of the container, e.g. "8:2048:4"
+        if ((field = strchr(argv[i+2], ':')))
+        {
+            shares[i] = strtoull(field + 1, NULL, 10);
+            if ((field = strchr(field + 1, ':')))
+                concurrency[i] = strtoull(field + 1, NULL, 10);
+        }
+        fprintf(stderr, "task for container %d: %d shares: %llu concurrency: %llu\n", i, tasks, shares[i], concurrency[i]);
         total_tasks += tasks;
         tasks_in_containers[i] = tasks;
         cid[i] = i;
@@ -111,18 +147,23 @@ int main(int argc, char *argv[])
     // alarm and mutex lock initialization
     pcontainer_init(devfd);
     pthread_mutex_init(&mutex, NULL);
+    fibers = getenv("PCONTAINER_FIBERS") != NULL;
 
     // create threads and assign tasks.
     threads = (pthread_t*) calloc(total_tasks, sizeof(pthread_t));
 	
 	//reset total teaks
 	total_tasks = 0;
+    gettimeofday(&start, NULL);
 
     for (i = 0; i < num_of_containers; i++)
     {
         for (tasks = 0; tasks < tasks_in_containers[i]; tasks++)
         {
-            if (pthread_create(&threads[total_tasks], NULL, thread_body, &cid[i])) {
+            if (fibers) {
+                if (pcontainer_fiber_create(devfd, cid[i], thread_body, &cid[i]))
+                    fprintf(stderr, "fiber create error.\n");
+            } else if (pthread_create(&threads[total_tasks], NULL, thread_body, &cid[i])) {
                 fprintf(stderr, "thread create error.\n");
             }
             total_tasks++;
@@ -130,14 +171,27 @@ int main(int argc, char *argv[])
     }
 
     // wait for terminations of threads
-    for (i = 0; i < total_tasks; i++)
-    {
-        pthread_join(threads[i], NULL);
-    }
+    if (fibers)
+        pcontainer_fiber_join();
+    else
+        for (i = 0; i < total_tasks; i++)
+        {
+            pthread_join(threads[i], NULL);
+        }
+    gettimeofday(&end, NULL);
+    elapsed = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+    fprintf(stderr, "Elapsed: %.3f s\n", elapsed);
+    // kernel context switches of all threads, and fiber switches done in user space
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(stderr, "Mode: %s Tasks/s: %.1f Kernel switches: %ld Fiber switches: %lld\n",
+            fibers ? "fiber" : "kernel", total_tasks / elapsed,
+            usage.ru_nvcsw + usage.ru_nivcsw, yields);
 
     // cleanup
     free(tasks_in_containers);
     free(threads);
     free(cid);
+    free(shares);
+    free(concurrency);
     return 0;
 }
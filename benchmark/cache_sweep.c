@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pcontainer.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define LINE 64
+
+int devfd;
+int node = -1;
+long accesses = 2000000;
+void **chain;
+volatile void *sink;
+
+/**
+ * monotonic clock in nanoseconds.
+ */
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Link the cache lines of a buffer of size bytes into one cycle in random
+ * order, so every access depends on the previous one and misses the
+ * prefetcher.
+ */
+static void build_chain(size_t size)
+{
+    size_t lines = size / LINE, i, j, tmp;
+    size_t *order = (size_t *) malloc(lines * sizeof(size_t));
+
+    for (i = 0; i < lines; i++)
+        order[i] = i;
+    for (i = lines - 1; i > 0; i--)
+    {
+        j = rand() % (i + 1);
+        tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+    for (i = 0; i < lines; i++)
+        chain[order[i] * LINE / sizeof(void *)] = &chain[order[(i + 1) % lines] * LINE / sizeof(void *)];
+    free(order);
+}
+
+/**
+ * Joins the container, optionally places it, and chases the shared chain.
+ * The members take turns, so a member finds the lines the previous one
+ * loaded only if it runs within the same caches.
+ */
+void *thread_body(void *x)
+{
+    void **p = chain;
+    long i;
+
+    pcontainer_create(devfd, 0);
+    if (node >= 0)
+        pcontainer_set_cpus(devfd, 0, 0, NULL, node);
+    for (i = 0; i < accesses; i++)
+        p = (void **)*p;
+    sink = p;
+    pcontainer_delete(devfd, 0);
+    return NULL;
+}
+
+/**
+ * usage: ./cache_sweep [tasks] [node] [max_kb]
+ *
+ * Sweeps the size of a working set shared by the rotating members of one
+ * container from 16 KB to max_kb and prints the time per access for each
+ * size. With node set, the container is placed on the CPUs of that NUMA
+ * node; -1 leaves placement to the scheduler.
+ */
+int main(int argc, char *argv[])
+{
+    int i, tasks = 4, max_kb = 65536;
+    size_t size;
+    long long start, elapsed;
+    pthread_t *threads;
+
+    if (argc > 1)
+        tasks = atoi(argv[1]);
+    if (argc > 2)
+        node = atoi(argv[2]);
+    if (argc > 3)
+        max_kb = atoi(argv[3]);
+
+    devfd = pcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed\n");
+        exit(1);
+    }
+    pcontainer_init(devfd);
+
+    chain = (void **) malloc((size_t)max_kb * 1024);
+    threads = (pthread_t *) calloc(tasks, sizeof(pthread_t));
+    for (size = 16 * 1024; size <= (size_t)max_kb * 1024; size *= 2)
+    {
+        build_chain(size);
+        start = now_ns();
+        for (i = 0; i < tasks; i++)
+            pthread_create(&threads[i], NULL, thread_body, NULL);
+        for (i = 0; i < tasks; i++)
+            pthread_join(threads[i], NULL);
+        elapsed = now_ns() - start;
+        printf("node %d tasks %d size_kb %zu ns_per_access %.2f\n",
+               node, tasks, size / 1024, (double)elapsed / ((double)accesses * tasks));
+    }
+
+    // cleanup
+    free(chain);
+    free(threads);
+    close(devfd);
+    return 0;
+}
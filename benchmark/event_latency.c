@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pcontainer.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#define EVENT_CID 5000000
+
+int devfd, watchfd;
+int iterations = 10000;
+volatile long long deleted_at;  // right before the delete call
+volatile int seen;              // DESTROYED events the watcher got
+long long *queued, *delivered;
+
+/**
+ * monotonic clock in nanoseconds.
+ */
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int cmp_ll(const void *a, const void *b)
+{
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Sleeps in poll() on its own file until an event comes in, and records
+ * for every DESTROYED event when it was queued and when it got here,
+ * relative to the delete call.
+ */
+void *watcher_body(void *x)
+{
+    struct processor_container_event events[16];
+    struct pollfd pfd = { .fd = watchfd, .events = POLLIN };
+    long long t;
+    int i, n;
+
+    while (seen < iterations)
+    {
+        if (poll(&pfd, 1, 1000) <= 0)
+            continue;
+        t = now_ns();
+        n = pcontainer_read_events(watchfd, events, 16);
+        for (i = 0; i < n; i++)
+        {
+            if (events[i].type != PCONTAINER_EVENT_DESTROYED)
+                continue;
+            queued[seen] = events[i].time_ns - deleted_at;
+            delivered[seen] = t - deleted_at;
+            __atomic_store_n(&seen, seen + 1, __ATOMIC_RELEASE);
+        }
+    }
+    return NULL;
+}
+
+static void report(const char *name, long long *x, int n)
+{
+    double mean = 0;
+    int i;
+
+    for (i = 0; i < n; i++)
+        mean += x[i];
+    qsort(x, n, sizeof(long long), cmp_ll);
+    printf("%s mean_ns %.0f p50_ns %lld p99_ns %lld max_ns %lld\n", name, mean / n,
+           x[n / 2], x[(long long)n * 99 / 100], x[n - 1]);
+}
+
+/**
+ * usage: ./event_latency [iterations]
+ *
+ * Creates and deletes a single-task container over and over while a
+ * watcher thread waits in poll() for PCONTAINER_EVENT_DESTROYED on a file
+ * of its own. Prints the time from the delete call until the event was
+ * queued, and until the watcher had read it.
+ */
+int main(int argc, char *argv[])
+{
+    pthread_t watcher;
+    int i;
+
+    if (argc > 1)
+        iterations = atoi(argv[1]);
+
+    devfd = pcontainer_open();
+    watchfd = pcontainer_open();
+    if (devfd < 0 || watchfd < 0)
+    {
+        fprintf(stderr, "Device open failed\n");
+        exit(1);
+    }
+    pcontainer_init(devfd);
+    if (pcontainer_watch(watchfd, EVENT_CID, 1 << PCONTAINER_EVENT_DESTROYED))
+    {
+        perror("pcontainer_watch");
+        exit(1);
+    }
+
+    queued = (long long *) calloc(iterations, sizeof(long long));
+    delivered = (long long *) calloc(iterations, sizeof(long long));
+    pthread_create(&watcher, NULL, watcher_body, NULL);
+    for (i = 0; i < iterations; i++)
+    {
+        pcontainer_create(devfd, EVENT_CID);
+        deleted_at = now_ns();
+        pcontainer_delete(devfd, EVENT_CID);
+        // one event in flight at a time
+        while (__atomic_load_n(&seen, __ATOMIC_ACQUIRE) <= i)
+            sched_yield();
+    }
+    pthread_join(watcher, NULL);
+
+    report("delete_to_queued", queued, iterations);
+    report("delete_to_read", delivered, iterations);
+
+    // cleanup
+    free(queued);
+    free(delivered);
+    close(watchfd);
+    close(devfd);
+    return 0;
+}
@@ -0,0 +1,376 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pcontainer.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define LATENCY_CID 1000000
+#define LOAD_CID 2000000
+#define CREATE_CID 3000000
+
+int devfd;
+int json = 0;
+int rows = 0;
+FILE *out;
+
+volatile long long entered;     // when the last switch call was made
+volatile int count;
+int iterations = 100000;
+long long *latency;
+
+volatile int running;
+
+struct worker
+{
+    int cid;
+    int concurrency;
+    long long ops;
+};
+
+/**
+ * monotonic clock in nanoseconds.
+ */
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int cmp_ll(const void *a, const void *b)
+{
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Write one result row. Metrics ending in _ns are better when lower, all
+ * others when higher; compare() relies on that.
+ */
+static void emit(const char *metric, int containers, int tasks, int concurrency, double value)
+{
+    if (json)
+        fprintf(out, "%s\n  {\"metric\": \"%s\", \"containers\": %d, \"tasks\": %d, \"concurrency\": %d, \"value\": %.6g}",
+                rows ? "," : "[", metric, containers, tasks, concurrency, value);
+    else
+    {
+        if (!rows)
+            fprintf(out, "metric,containers,tasks,concurrency,value\n");
+        fprintf(out, "%s,%d,%d,%d,%.6g\n", metric, containers, tasks, concurrency, value);
+    }
+    rows++;
+}
+
+/**
+ * Jain's fairness index of n values, 1 when all are equal and 1/n when one
+ * of them got everything.
+ */
+static double jain(const double *x, int n)
+{
+    double sum = 0, sum_sq = 0;
+    int i;
+
+    for (i = 0; i < n; i++)
+    {
+        sum += x[i];
+        sum_sq += x[i] * x[i];
+    }
+    return sum_sq ? sum * sum / (n * sum_sq) : 1;
+}
+
+/**
+ * One of the two members of the latency container, see pingpong.c.
+ */
+void *pingpong_body(void *x)
+{
+    long long t;
+
+    pcontainer_create(devfd, LATENCY_CID);
+    while (count < iterations)
+    {
+        t = now_ns();
+        if (entered)
+            latency[count++] = t - entered;
+        entered = now_ns();
+        pcontainer_context_switch_handler(devfd, LATENCY_CID);
+    }
+    pcontainer_delete(devfd, LATENCY_CID);
+    return NULL;
+}
+
+/**
+ * Distribution of the time from one task entering the switch ioctl to the
+ * next one of its container returning from it.
+ */
+static void bench_switch_latency(void)
+{
+    struct processor_container_stats stats;
+    pthread_t threads[2];
+    double mean = 0;
+    int i;
+
+    latency = (long long *) calloc(iterations, sizeof(long long));
+    entered = 0;
+    count = 0;
+    // only explicit switch calls rotate the container
+    pcontainer_create(devfd, LATENCY_CID);
+    pcontainer_set_quantum(devfd, LATENCY_CID, 0);
+    for (i = 0; i < 2; i++)
+        pthread_create(&threads[i], NULL, pingpong_body, NULL);
+    while (pcontainer_stats(devfd, LATENCY_CID, &stats) || stats.nr_tasks < 3)
+        usleep(100);
+    pcontainer_delete(devfd, LATENCY_CID);
+    for (i = 0; i < 2; i++)
+        pthread_join(threads[i], NULL);
+
+    if (count)
+    {
+        for (i = 0; i < count; i++)
+            mean += latency[i];
+        qsort(latency, count, sizeof(long long), cmp_ll);
+        emit("switch_mean_ns", 1, 2, 1, mean / count);
+        emit("switch_p50_ns", 1, 2, 1, latency[count / 2]);
+        emit("switch_p99_ns", 1, 2, 1, latency[(long long)count * 99 / 100]);
+        emit("switch_p999_ns", 1, 2, 1, latency[(long long)count * 999 / 1000]);
+    }
+    free(latency);
+}
+
+/**
+ * Create and delete fresh single-task containers as fast as possible.
+ */
+static void bench_create_delete(void)
+{
+    long long start, elapsed;
+    int i, n = 100000;
+
+    start = now_ns();
+    for (i = 0; i < n; i++)
+    {
+        pcontainer_create(devfd, CREATE_CID + i);
+        pcontainer_delete(devfd, CREATE_CID + i);
+    }
+    elapsed = now_ns() - start;
+    emit("create_delete_per_s", 1, 1, 1, n / (elapsed / 1e9));
+    emit("create_delete_ns", 1, 1, 1, (double)elapsed / n);
+}
+
+/**
+ * CPU-bound member of a load container, counts chunks of work.
+ */
+void *load_body(void *x)
+{
+    struct worker *w = (struct worker *)x;
+    volatile long long sink = 0;
+    int j;
+
+    pcontainer_create(devfd, w->cid);
+    if (w->concurrency > 1)
+        pcontainer_set_concurrency(devfd, w->cid, w->concurrency);
+    while (running)
+    {
+        for (j = 0; j < 1000; j++)
+            sink += j;
+        w->ops++;
+    }
+    pcontainer_delete(devfd, w->cid);
+    return NULL;
+}
+
+/**
+ * Run containers x tasks CPU-bound tasks for seconds and report the work
+ * done, the fairness between containers, and the mean fairness between
+ * the tasks of a container.
+ */
+static void bench_load(int containers, int tasks, int concurrency, int seconds)
+{
+    struct worker *w = (struct worker *) calloc(containers * tasks, sizeof(struct worker));
+    pthread_t *threads = (pthread_t *) calloc(containers * tasks, sizeof(pthread_t));
+    double *per_container = (double *) calloc(containers, sizeof(double));
+    double *per_task = (double *) calloc(tasks, sizeof(double));
+    double total = 0, within = 0;
+    int i, c, t;
+
+    running = 1;
+    for (i = 0; i < containers * tasks; i++)
+    {
+        w[i].cid = LOAD_CID + i % containers;
+        w[i].concurrency = concurrency;
+        pthread_create(&threads[i], NULL, load_body, &w[i]);
+    }
+    sleep(seconds);
+    running = 0;
+    for (i = 0; i < containers * tasks; i++)
+        pthread_join(threads[i], NULL);
+
+    for (c = 0; c < containers; c++)
+    {
+        for (t = 0; t < tasks; t++)
+        {
+            per_task[t] = w[t * containers + c].ops;
+            per_container[c] += per_task[t];
+        }
+        total += per_container[c];
+        within += jain(per_task, tasks);
+    }
+    emit("ops_per_s", containers, tasks, concurrency, total / seconds);
+    emit("fairness_containers", containers, tasks, concurrency, jain(per_container, containers));
+    emit("fairness_tasks", containers, tasks, concurrency, within / containers);
+
+    free(w);
+    free(threads);
+    free(per_container);
+    free(per_task);
+}
+
+struct result
+{
+    char key[256];
+    double value;
+};
+
+/**
+ * Read the rows of a CSV file written by this program.
+ */
+static struct result *read_results(const char *path, int *n)
+{
+    struct result *r = NULL;
+    char line[256], *comma;
+    FILE *f = fopen(path, "r");
+
+    *n = 0;
+    if (!f)
+    {
+        perror(path);
+        exit(2);
+    }
+    while (fgets(line, sizeof(line), f))
+    {
+        if (!strncmp(line, "metric,", 7) || !(comma = strrchr(line, ',')))
+            continue;
+        r = (struct result *) realloc(r, (*n + 1) * sizeof(struct result));
+        *comma = '\0';
+        snprintf(r[*n].key, sizeof(r[*n].key), "%s", line);
+        r[*n].value = atof(comma + 1);
+        (*n)++;
+    }
+    fclose(f);
+    return r;
+}
+
+/**
+ * Print the change of every metric of run b against run a, and return 1 if
+ * any of them got worse by more than threshold percent.
+ */
+static int compare(const char *a, const char *b, double threshold)
+{
+    struct result *old, *cur;
+    int n_old, n_cur, i, j, regressed = 0, worse;
+    double change;
+
+    old = read_results(a, &n_old);
+    cur = read_results(b, &n_cur);
+    printf("metric,containers,tasks,concurrency,old,new,change_pct,verdict\n");
+    for (i = 0; i < n_cur; i++)
+    {
+        for (j = 0; j < n_old; j++)
+            if (!strcmp(old[j].key, cur[i].key))
+                break;
+        if (j == n_old || !old[j].value)
+            continue;
+        change = (cur[i].value - old[j].value) * 100 / old[j].value;
+        // the metric name ends right before the first comma
+        worse = strstr(cur[i].key, "_ns,") ? change > threshold : change < -threshold;
+        regressed |= worse;
+        printf("%s,%.6g,%.6g,%+.1f,%s\n", cur[i].key, old[j].value, cur[i].value, change,
+               worse ? "REGRESSION" : "ok");
+    }
+    free(old);
+    free(cur);
+    return regressed;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: ./harness [-j] [-o file] [-s seconds] [-c containers] [-t tasks] [-k concurrency] [-n iterations]\n");
+    fprintf(stderr, "       ./harness -C old.csv new.csv [threshold_pct]\n");
+    exit(2);
+}
+
+/**
+ * Runs the switch latency, create/delete and load benchmarks and writes one
+ * row per metric as CSV, or as JSON with -j. The load benchmark sweeps
+ * containers, tasks per container and concurrency over the powers of two
+ * up to the given maxima. -C compares two CSV runs and exits with 1 if a
+ * metric regressed by more than threshold_pct (default 10).
+ */
+int main(int argc, char *argv[])
+{
+    int opt, c, t, k, seconds = 1, max_containers = 4, max_tasks = 4, max_concurrency = 2;
+
+    out = stdout;
+    while ((opt = getopt(argc, argv, "jo:s:c:t:k:n:C")) != -1)
+    {
+        switch (opt)
+        {
+        case 'j':
+            json = 1;
+            break;
+        case 'o':
+            if (!(out = fopen(optarg, "w")))
+            {
+                perror(optarg);
+                exit(2);
+            }
+            break;
+        case 's':
+            seconds = atoi(optarg);
+            break;
+        case 'c':
+            max_containers = atoi(optarg);
+            break;
+        case 't':
+            max_tasks = atoi(optarg);
+            break;
+        case 'k':
+            max_concurrency = atoi(optarg);
+            break;
+        case 'n':
+            iterations = atoi(optarg);
+            break;
+        case 'C':
+            if (argc - optind < 2)
+                usage();
+            return compare(argv[optind], argv[optind + 1],
+                           argc - optind > 2 ? atof(argv[optind + 2]) : 10);
+        default:
+            usage();
+        }
+    }
+
+    devfd = pcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed\n");
+        exit(1);
+    }
+    pcontainer_init(devfd);
+
+    bench_switch_latency();
+    bench_create_delete();
+    for (c = 1; c <= max_containers; c *= 2)
+        for (t = 1; t <= max_tasks; t *= 2)
+            for (k = 1; k <= max_concurrency && k <= t; k *= 2)
+                bench_load(c, t, k, seconds);
+    if (json)
+        fprintf(out, "%s\n]\n", rows ? "" : "[");
+
+    // cleanup
+    if (out != stdout)
+        fclose(out);
+    close(devfd);
+    return 0;
+}
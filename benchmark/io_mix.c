@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pcontainer.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+int devfd;
+int sleep_us = 1000;
+volatile int running = 1;
+
+struct worker
+{
+    int io;                 // blocks between bursts instead of spinning
+    long long ops;
+};
+
+/**
+ * Joins the container and either spins, counting iterations, or alternates
+ * short bursts of work with sleeps that stand in for disk or network I/O.
+ */
+void *thread_body(void *x)
+{
+    struct worker *w = (struct worker *)x;
+    struct timespec ts = { 0, sleep_us * 1000L };
+    volatile long long sink = 0;
+    int j;
+
+    pcontainer_create(devfd, 0);
+    while (running)
+    {
+        for (j = 0; j < 1000; j++)
+            sink += j;
+        w->ops++;
+        if (w->io)
+            nanosleep(&ts, NULL);
+    }
+    pcontainer_delete(devfd, 0);
+    return NULL;
+}
+
+/**
+ * usage: ./io_mix [cpu_tasks] [io_tasks] [seconds] [sleep_us]
+ *
+ * Runs CPU-bound and I/O-bound tasks in one container and reports the work
+ * done by each kind together with the CPU utilization of the container,
+ * which stays near 1 when a blocking member does not hold up the others.
+ * Compare with /sys/module/processor_container/parameters/block_aware
+ * set to 0.
+ */
+int main(int argc, char *argv[])
+{
+    int i, cpu_tasks = 2, io_tasks = 2, seconds = 5;
+    long long cpu_ops = 0, io_ops = 0;
+    double cpu_s;
+    struct timeval start, end;
+    struct rusage usage;
+    struct worker *w;
+    pthread_t *threads;
+
+    if (argc > 1)
+        cpu_tasks = atoi(argv[1]);
+    if (argc > 2)
+        io_tasks = atoi(argv[2]);
+    if (argc > 3)
+        seconds = atoi(argv[3]);
+    if (argc > 4)
+        sleep_us = atoi(argv[4]);
+
+    devfd = pcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed\n");
+        exit(1);
+    }
+    pcontainer_init(devfd);
+
+    w = (struct worker *) calloc(cpu_tasks + io_tasks, sizeof(struct worker));
+    threads = (pthread_t *) calloc(cpu_tasks + io_tasks, sizeof(pthread_t));
+    gettimeofday(&start, NULL);
+    for (i = 0; i < cpu_tasks + io_tasks; i++)
+    {
+        w[i].io = i >= cpu_tasks;
+        pthread_create(&threads[i], NULL, thread_body, &w[i]);
+    }
+    sleep(seconds);
+    running = 0;
+    for (i = 0; i < cpu_tasks + io_tasks; i++)
+        pthread_join(threads[i], NULL);
+    gettimeofday(&end, NULL);
+
+    for (i = 0; i < cpu_tasks + io_tasks; i++)
+    {
+        if (w[i].io)
+            io_ops += w[i].ops;
+        else
+            cpu_ops += w[i].ops;
+    }
+    getrusage(RUSAGE_SELF, &usage);
+    cpu_s = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+            usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    printf("cpu_tasks %d io_tasks %d cpu_ops %lld io_ops %lld utilization %.3f\n",
+           cpu_tasks, io_tasks, cpu_ops, io_ops,
+           cpu_s / ((end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6));
+
+    // cleanup
+    free(w);
+    free(threads);
+    close(devfd);
+    return 0;
+}
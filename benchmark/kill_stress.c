@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pcontainer.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define KILL_CID 4000000
+#define TIMEOUT_NS 10000000000LL
+
+int devfd;
+volatile long long *ops;    // one counter per child, shared with the parent
+
+/**
+ * monotonic clock in nanoseconds.
+ */
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Joins the shared container and counts chunks of work until it is killed;
+ * it never deletes itself.
+ */
+static void child_body(int i)
+{
+    volatile long long sink = 0;
+    int j;
+
+    devfd = pcontainer_open();
+    if (devfd < 0)
+        exit(1);
+    pcontainer_init(devfd);
+    pcontainer_create(devfd, KILL_CID);
+    for (;;)
+    {
+        for (j = 0; j < 1000; j++)
+            sink += j;
+        ops[i]++;
+    }
+}
+
+static long long sum_ops(int from, int to)
+{
+    long long total = 0;
+    int i;
+
+    for (i = from; i < to; i++)
+        total += ops[i];
+    return total;
+}
+
+/**
+ * usage: ./kill_stress [tasks] [kills] [seconds]
+ *
+ * Forks tasks processes into one container, SIGKILLs the first kills of
+ * them while they run, and prints the work done per second before and
+ * after, the time until the survivors make progress again (recovery_ms),
+ * and the time until the container is down to its survivors (reap_ms,
+ * -1 if the backend keeps no shared stats). A killed task never deletes
+ * itself, so both stay at "timeout" if exiting tasks are not reaped.
+ */
+int main(int argc, char *argv[])
+{
+    int i, tasks = 4, kills = 2, seconds = 2;
+    long long start, before, after, recovery = -1, reap = -1, base;
+    struct processor_container_stats stats;
+    pid_t *pids;
+
+    if (argc > 1)
+        tasks = atoi(argv[1]);
+    if (argc > 2)
+        kills = atoi(argv[2]);
+    if (argc > 3)
+        seconds = atoi(argv[3]);
+    if (kills >= tasks)
+        kills = tasks - 1;
+
+    ops = (volatile long long *) mmap(NULL, tasks * sizeof(long long), PROT_READ | PROT_WRITE,
+                                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    pids = (pid_t *) calloc(tasks, sizeof(pid_t));
+    if (ops == MAP_FAILED || !pids)
+    {
+        perror("alloc");
+        exit(1);
+    }
+    for (i = 0; i < tasks; i++)
+    {
+        if (!(pids[i] = fork()))
+            child_body(i);
+    }
+    devfd = pcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed\n");
+        exit(1);
+    }
+
+    // steady state with every task alive
+    sleep(1);
+    base = sum_ops(0, tasks);
+    sleep(seconds);
+    before = sum_ops(0, tasks) - base;
+
+    base = sum_ops(kills, tasks);
+    start = now_ns();
+    for (i = 0; i < kills; i++)
+        kill(pids[i], SIGKILL);
+    for (i = 0; i < kills; i++)
+        waitpid(pids[i], NULL, 0);
+    while (now_ns() - start < TIMEOUT_NS && (recovery < 0 || reap == -1))
+    {
+        if (recovery < 0 && sum_ops(kills, tasks) != base)
+            recovery = now_ns() - start;
+        if (reap == -1)
+        {
+            // -2 when the container cannot be looked up from here
+            if (pcontainer_stats(devfd, KILL_CID, &stats))
+                reap = -2;
+            else if (stats.nr_tasks == (unsigned long long)(tasks - kills))
+                reap = now_ns() - start;
+        }
+        usleep(100);
+    }
+
+    base = sum_ops(kills, tasks);
+    sleep(seconds);
+    after = sum_ops(kills, tasks) - base;
+
+    printf("tasks %d kills %d before_ops_per_s %.0f after_ops_per_s %.0f", tasks, kills,
+           (double)before / seconds, (double)after / seconds);
+    if (recovery < 0)
+        printf(" recovery_ms timeout");
+    else
+        printf(" recovery_ms %.3f", recovery / 1e6);
+    if (reap == -1)
+        printf(" reap_ms timeout\n");
+    else
+        printf(" reap_ms %.3f\n", reap == -2 ? -1 : reap / 1e6);
+
+    // cleanup, the survivors are reaped the same way
+    for (i = kills; i < tasks; i++)
+        kill(pids[i], SIGKILL);
+    for (i = kills; i < tasks; i++)
+        waitpid(pids[i], NULL, 0);
+    free(pids);
+    close(devfd);
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pcontainer.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define LOCK_ID 0
+
+int devfd;
+int use_pcontainer = 1;
+int iterations = 100000;
+pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+volatile long long counter = 0;
+
+/**
+ * monotonic clock in nanoseconds.
+ */
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Joins its container and hammers one lock shared by all tasks of all
+ * containers, doing a little work inside the critical section so that a
+ * holder which gets preempted keeps everybody else waiting.
+ */
+void *thread_body(void *x)
+{
+    int cid = *(int *)x, i, j;
+
+    pcontainer_create(devfd, cid);
+    for (i = 0; i < iterations; i++)
+    {
+        if (use_pcontainer)
+            pcontainer_lock(devfd, LOCK_ID);
+        else
+            pthread_mutex_lock(&mutex);
+        for (j = 0; j < 100; j++)
+            counter++;
+        if (use_pcontainer)
+            pcontainer_unlock(devfd, LOCK_ID);
+        else
+            pthread_mutex_unlock(&mutex);
+    }
+    pcontainer_delete(devfd, cid);
+    return NULL;
+}
+
+/**
+ * usage: ./lock_contention [pthread|pcontainer] [containers] [tasks] [iterations]
+ *
+ * Compares a pthread mutex with the container-aware lock under contention
+ * and reports acquisitions per second.
+ */
+int main(int argc, char *argv[])
+{
+    int i, containers = 2, tasks = 4;
+    int *cids;
+    long long start, elapsed;
+    pthread_t *threads;
+
+    if (argc > 1)
+        use_pcontainer = strcmp(argv[1], "pthread") != 0;
+    if (argc > 2)
+        containers = atoi(argv[2]);
+    if (argc > 3)
+        tasks = atoi(argv[3]);
+    if (argc > 4)
+        iterations = atoi(argv[4]);
+
+    devfd = pcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed\n");
+        exit(1);
+    }
+    pcontainer_init(devfd);
+
+    cids = (int *) calloc(containers * tasks, sizeof(int));
+    threads = (pthread_t *) calloc(containers * tasks, sizeof(pthread_t));
+    start = now_ns();
+    for (i = 0; i < containers * tasks; i++)
+    {
+        cids[i] = i % containers;
+        pthread_create(&threads[i], NULL, thread_body, &cids[i]);
+    }
+    for (i = 0; i < containers * tasks; i++)
+        pthread_join(threads[i], NULL);
+    elapsed = now_ns() - start;
+
+    printf("%s containers %d tasks %d ops %lld ops_per_sec %.0f\n",
+           use_pcontainer ? "pcontainer" : "pthread", containers, tasks,
+           (long long)containers * tasks * iterations,
+           (double)containers * tasks * iterations * 1e9 / elapsed);
+
+    // cleanup
+    free(cids);
+    free(threads);
+    close(devfd);
+    return 0;
+}
@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pcontainer.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+int devfd;
+volatile int done = 0;
+pthread_barrier_t barrier;
+
+/**
+ * monotonic clock in nanoseconds.
+ */
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * A worker that never touches the containers itself; the supervisor
+ * attaches and moves it around while it spins.
+ */
+void *worker_body(void *x)
+{
+    pid_t *tid = (pid_t *)x;
+
+    *tid = syscall(SYS_gettid);
+    pthread_barrier_wait(&barrier);
+    while (!done)
+        ;
+    // it is in one of the two, whichever the last migration left it in
+    pcontainer_delete(devfd, 0);
+    pcontainer_delete(devfd, 1);
+    return NULL;
+}
+
+static int compare(const void *a, const void *b)
+{
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * usage: ./migrate_cost [workers] [iterations]
+ *
+ * Attaches all workers of this process to container 0 in one call, then
+ * moves one worker back and forth between containers 0 and 1 and reports
+ * the cost of a single migration.
+ */
+int main(int argc, char *argv[])
+{
+    int i, workers = 4, iterations = 10000, ret;
+    long long start, *samples, sum = 0;
+    pid_t *tids;
+    pthread_t *threads;
+
+    if (argc > 1)
+        workers = atoi(argv[1]);
+    if (argc > 2)
+        iterations = atoi(argv[2]);
+
+    devfd = pcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed\n");
+        exit(1);
+    }
+    pcontainer_init(devfd);
+
+    tids = (pid_t *) calloc(workers, sizeof(pid_t));
+    threads = (pthread_t *) calloc(workers, sizeof(pthread_t));
+    samples = (long long *) calloc(iterations, sizeof(long long));
+    pthread_barrier_init(&barrier, NULL, workers + 1);
+    for (i = 0; i < workers; i++)
+        pthread_create(&threads[i], NULL, worker_body, &tids[i]);
+    pthread_barrier_wait(&barrier);
+
+    for (i = 0; i < workers; i++)
+        if ((ret = pcontainer_attach(devfd, 0, tids[i])))
+            fprintf(stderr, "attach of %d failed: %d\n", tids[i], ret);
+
+    for (i = 0; i < iterations; i++)
+    {
+        start = now_ns();
+        pcontainer_migrate(devfd, i % 2, (i + 1) % 2, tids[0]);
+        samples[i] = now_ns() - start;
+        sum += samples[i];
+    }
+    qsort(samples, iterations, sizeof(long long), compare);
+    printf("workers %d migrations %d mean_ns %lld p50_ns %lld p99_ns %lld\n", workers, iterations,
+           sum / iterations, samples[iterations / 2], samples[iterations * 99 / 100]);
+
+    // cleanup
+    done = 1;
+    for (i = 0; i < workers; i++)
+        pthread_kill(threads[i], SIGPROF);
+    for (i = 0; i < workers; i++)
+        pthread_join(threads[i], NULL);
+    free(tids);
+    free(threads);
+    free(samples);
+    close(devfd);
+    return 0;
+}
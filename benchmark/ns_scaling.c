@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pcontainer.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define CIDS 16
+
+int devfd;
+volatile int *go;               // set by the parent once every child is ready
+volatile long long *ops;        // one counter per child, shared with the parent
+
+/**
+ * Opens the device, moves into a namespace of its own unless shared, and
+ * creates and deletes containers until it is killed. Shared children use
+ * cids of their own so that they only meet in the index, not in the
+ * containers; private ones all use the same cids.
+ */
+static void child_body(int i, int shared)
+{
+    int n, base = shared ? (i + 1) * CIDS : 0;
+
+    devfd = pcontainer_open();
+    if (devfd < 0)
+        _exit(1);
+    if (!shared && pcontainer_new_ns(devfd))
+    {
+        perror("pcontainer_new_ns");
+        _exit(1);
+    }
+    pcontainer_init(devfd);
+    while (!*go)
+        usleep(100);
+    for (n = 0;; n++)
+    {
+        pcontainer_create(devfd, base + n % CIDS);
+        pcontainer_delete(devfd, base + n % CIDS);
+        ops[i]++;
+    }
+}
+
+/**
+ * Run processes children for seconds and return their create/delete pairs
+ * per second.
+ */
+static double run(int processes, int seconds, int shared)
+{
+    pid_t *pids = (pid_t *) calloc(processes, sizeof(pid_t));
+    long long total = 0;
+    int i;
+
+    *go = 0;
+    memset((void *)ops, 0, processes * sizeof(long long));
+    // the children must not flush what the parent printed so far
+    fflush(stdout);
+    for (i = 0; i < processes; i++)
+    {
+        if (!(pids[i] = fork()))
+            child_body(i, shared);
+    }
+    sleep(1);
+    *go = 1;
+    sleep(seconds);
+    for (i = 0; i < processes; i++)
+        total += ops[i];
+    for (i = 0; i < processes; i++)
+        kill(pids[i], SIGKILL);
+    for (i = 0; i < processes; i++)
+        waitpid(pids[i], NULL, 0);
+    free(pids);
+    return (double)total / seconds;
+}
+
+/**
+ * usage: ./ns_scaling [max_processes] [seconds]
+ *
+ * Runs 1, 2, 4, ... up to max_processes processes that create and delete
+ * containers as fast as they can, once all in the shared namespace and
+ * once each in a namespace of its own, and prints the create/delete pairs
+ * per second and per process. With private namespaces the processes share
+ * no index, so the rate per process should stay flat as they are added.
+ */
+int main(int argc, char *argv[])
+{
+    int p, max_processes = 4, seconds = 2, shared;
+    double rate;
+
+    if (argc > 1)
+        max_processes = atoi(argv[1]);
+    if (argc > 2)
+        seconds = atoi(argv[2]);
+
+    go = (volatile int *) mmap(NULL, sizeof(int), PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    ops = (volatile long long *) mmap(NULL, max_processes * sizeof(long long), PROT_READ | PROT_WRITE,
+                                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (go == MAP_FAILED || ops == MAP_FAILED)
+    {
+        perror("mmap");
+        exit(1);
+    }
+    for (p = 1; p <= max_processes; p *= 2)
+    {
+        for (shared = 1; shared >= 0; shared--)
+        {
+            rate = run(p, seconds, shared);
+            printf("%s processes %d ops_per_s %.0f per_process %.0f\n",
+                   shared ? "shared" : "private", p, rate, rate / p);
+        }
+    }
+    return 0;
+}
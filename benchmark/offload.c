@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pcontainer.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+int devfd;
+volatile int running = 1;
+
+struct worker
+{
+    int cid;
+    unsigned long long shares;
+    long long ops;
+};
+
+/**
+ * Joins its container, gives it its shares, and counts chunks of work.
+ */
+void *thread_body(void *x)
+{
+    struct worker *w = (struct worker *)x;
+    volatile long long sink = 0;
+    int j;
+
+    // a backend that cannot be set up would leave the tasks unmanaged
+    if (pcontainer_create(devfd, w->cid) < 0)
+        perror("pcontainer_create");
+    pcontainer_set_shares(devfd, w->cid, w->shares);
+    while (running)
+    {
+        for (j = 0; j < 1000; j++)
+            sink += j;
+        w->ops++;
+    }
+    pcontainer_delete(devfd, w->cid);
+    return NULL;
+}
+
+/**
+ * usage: ./offload [containers] [tasks] [seconds]
+ *
+ * Runs CPU-bound tasks in containers whose shares grow with the cid
+ * (1024, 2048, ...) on the backend PCONTAINER_BACKEND selects. It prints
+ * the work done, Jain's fairness index of the work per share of every
+ * container (1 when the CPU is split exactly by shares), the system CPU
+ * time and the context switch rate. Run it once with the kernel module and
+ * once with PCONTAINER_BACKEND=cgroup to compare round-robin switching
+ * with CFS doing the rotation.
+ */
+int main(int argc, char *argv[])
+{
+    int i, containers = 2, tasks = 2, seconds = 5;
+    long long total = 0;
+    double *per_share, sum = 0, sum_sq = 0, cpu_s, sys_s;
+    const char *backend = getenv("PCONTAINER_BACKEND");
+    struct rusage usage;
+    struct worker *w;
+    pthread_t *threads;
+
+    if (argc > 1)
+        containers = atoi(argv[1]);
+    if (argc > 2)
+        tasks = atoi(argv[2]);
+    if (argc > 3)
+        seconds = atoi(argv[3]);
+
+    devfd = pcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed\n");
+        exit(1);
+    }
+    pcontainer_init(devfd);
+
+    w = (struct worker *) calloc(containers * tasks, sizeof(struct worker));
+    threads = (pthread_t *) calloc(containers * tasks, sizeof(pthread_t));
+    per_share = (double *) calloc(containers, sizeof(double));
+    for (i = 0; i < containers * tasks; i++)
+    {
+        w[i].cid = i % containers;
+        w[i].shares = 1024ULL * (w[i].cid + 1);
+        pthread_create(&threads[i], NULL, thread_body, &w[i]);
+    }
+    sleep(seconds);
+    running = 0;
+    for (i = 0; i < containers * tasks; i++)
+        pthread_join(threads[i], NULL);
+
+    for (i = 0; i < containers * tasks; i++)
+    {
+        total += w[i].ops;
+        per_share[w[i].cid] += (double)w[i].ops / w[i].shares;
+    }
+    for (i = 0; i < containers; i++)
+    {
+        sum += per_share[i];
+        sum_sq += per_share[i] * per_share[i];
+    }
+    getrusage(RUSAGE_SELF, &usage);
+    sys_s = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    cpu_s = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + sys_s;
+    printf("backend %s containers %d tasks %d ops %lld weighted_fairness %.4f cpu_s %.3f sys_s %.3f ctx_switches_per_s %.0f\n",
+           backend ? backend : "kernel", containers, tasks, total,
+           sum_sq ? sum * sum / (containers * sum_sq) : 1, cpu_s, sys_s,
+           (double)(usage.ru_nvcsw + usage.ru_nivcsw) / seconds);
+
+    // cleanup
+    free(w);
+    free(threads);
+    free(per_share);
+    close(devfd);
+    return 0;
+}
@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pcontainer.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <string.h>
+
+int devfd;
+int iterations = 100000;
+int fibers = 0;
+volatile long long entered;     // when the last switch call was made
+volatile int count;
+long long *latency;
+
+/**
+ * monotonic clock in nanoseconds.
+ */
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int cmp_ll(const void *a, const void *b)
+{
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * One of the two members of the container. Whenever it gets the slot, it
+ * records how long ago the other one entered the switch ioctl, and then
+ * switches back to it.
+ */
+void *thread_body(void *x)
+{
+    long long t;
+
+    pcontainer_create(devfd, 0);
+    while (count < iterations)
+    {
+        t = now_ns();
+        if (entered)
+            latency[count++] = t - entered;
+        entered = now_ns();
+        pcontainer_context_switch_handler(devfd, 0);
+    }
+    pcontainer_delete(devfd, 0);
+    return NULL;
+}
+
+/**
+ * The same as thread_body() for two fibers of one container, which hand
+ * the carrier thread back and forth without entering the kernel.
+ */
+void *fiber_body(void *x)
+{
+    long long t;
+
+    while (count < iterations)
+    {
+        t = now_ns();
+        if (entered)
+            latency[count++] = t - entered;
+        entered = now_ns();
+        pcontainer_fiber_yield();
+    }
+    return NULL;
+}
+
+/**
+ * usage: ./pingpong [iterations] [fiber]
+ *
+ * Two tasks of one container hand the slot back and forth with explicit
+ * switch calls, and the time from the outgoing task entering the ioctl to
+ * the incoming one returning from it is reported. Compare with
+ * /sys/module/processor_container/parameters/handoff set to 0, or with
+ * fiber to measure the same exchange between two fibers.
+ */
+int main(int argc, char *argv[])
+{
+    int i;
+    double mean = 0;
+    struct processor_container_stats stats;
+    pthread_t threads[2];
+
+    if (argc > 1)
+        iterations = atoi(argv[1]);
+    if (argc > 2)
+        fibers = strcmp(argv[2], "fiber") == 0;
+
+    devfd = pcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed\n");
+        exit(1);
+    }
+    pcontainer_init(devfd);
+
+    latency = (long long *) calloc(iterations, sizeof(long long));
+    if (fibers)
+    {
+        for (i = 0; i < 2; i++)
+            pcontainer_fiber_create(devfd, 0, fiber_body, NULL);
+        pcontainer_fiber_join();
+    }
+    else
+    {
+        // only explicit switch calls rotate the container
+        pcontainer_create(devfd, 0);
+        pcontainer_set_quantum(devfd, 0, 0);
+        for (i = 0; i < 2; i++)
+            pthread_create(&threads[i], NULL, thread_body, NULL);
+        // leave once both joined, which hands the slot to the first of them
+        while (pcontainer_stats(devfd, 0, &stats) || stats.nr_tasks < 3)
+            usleep(100);
+        pcontainer_delete(devfd, 0);
+        for (i = 0; i < 2; i++)
+            pthread_join(threads[i], NULL);
+    }
+
+    for (i = 0; i < count; i++)
+        mean += latency[i];
+    mean = count ? mean / count : 0;
+    qsort(latency, count, sizeof(long long), cmp_ll);
+    printf("%s switches %d mean_ns %.0f p50_ns %lld p99_ns %lld\n",
+           fibers ? "fiber" : "kernel", count, mean, count ? latency[count / 2] : 0, count ? latency[count * 99 / 100] : 0);
+
+    // cleanup
+    free(latency);
+    close(devfd);
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pcontainer.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+int devfd;
+int yield_us = 0;
+volatile int running;
+
+struct worker
+{
+    int cid;
+    long long ops;
+};
+
+struct setting
+{
+    const char *name;
+    unsigned long long quantum_ns;
+    int adaptive;
+};
+
+/**
+ * monotonic clock in nanoseconds.
+ */
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Joins the container and counts chunks of work until told to stop. With
+ * yield_us set, it gives up its slot after that much work, like a
+ * latency-sensitive task would, instead of running until it is preempted.
+ */
+void *thread_body(void *x)
+{
+    struct worker *w = (struct worker *)x;
+    volatile long long sink = 0;
+    long long start = now_ns();
+    int j;
+
+    pcontainer_create(devfd, w->cid);
+    while (running)
+    {
+        for (j = 0; j < 1000; j++)
+            sink += j;
+        w->ops++;
+        if (yield_us && now_ns() - start >= yield_us * 1000LL)
+        {
+            pcontainer_context_switch_handler(devfd, w->cid);
+            start = now_ns();
+        }
+    }
+    pcontainer_delete(devfd, w->cid);
+    return NULL;
+}
+
+/**
+ * usage: ./quantum [tasks] [seconds] [yield_us]
+ *
+ * Runs CPU-bound tasks in one container with a short, a medium and a long
+ * time slice and with the adaptive slice, and prints for each the work
+ * done, the switch rate, the slice in use at the end, and Jain's fairness
+ * index of the work of the tasks (1 is perfectly fair). Less work at a
+ * higher switch rate is the cost of switching. yield_us makes the tasks
+ * switch by themselves after that much work.
+ */
+int main(int argc, char *argv[])
+{
+    struct setting settings[] = {
+        { "100us", 100000, 0 },
+        { "1ms", 1000000, 0 },
+        { "10ms", 10000000, 0 },
+        { "adaptive", 1000000, 1 },
+    };
+    int i, s, tasks = 4, seconds = 3;
+    long long total;
+    double sum_sq, jain;
+    struct processor_container_stats stats;
+    struct worker *w;
+    pthread_t *threads;
+
+    if (argc > 1)
+        tasks = atoi(argv[1]);
+    if (argc > 2)
+        seconds = atoi(argv[2]);
+    if (argc > 3)
+        yield_us = atoi(argv[3]);
+
+    devfd = pcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed\n");
+        exit(1);
+    }
+    pcontainer_init(devfd);
+
+    w = (struct worker *) calloc(tasks, sizeof(struct worker));
+    threads = (pthread_t *) calloc(tasks, sizeof(pthread_t));
+    for (s = 0; s < (int)(sizeof(settings) / sizeof(settings[0])); s++)
+    {
+        running = 1;
+        // configure the container before any worker gets a slot
+        pcontainer_create(devfd, s);
+        pcontainer_set_quantum(devfd, s, settings[s].quantum_ns);
+        pcontainer_set_adaptive(devfd, s, settings[s].adaptive);
+        for (i = 0; i < tasks; i++)
+        {
+            w[i].cid = s;
+            w[i].ops = 0;
+            pthread_create(&threads[i], NULL, thread_body, &w[i]);
+        }
+        while (pcontainer_stats(devfd, s, &stats) || stats.nr_tasks < (unsigned long long)tasks + 1)
+            usleep(100);
+        pcontainer_delete(devfd, s);
+        sleep(seconds);
+        // read the counters while the container still exists
+        pcontainer_stats(devfd, s, &stats);
+        running = 0;
+        for (i = 0; i < tasks; i++)
+            pthread_join(threads[i], NULL);
+
+        total = 0;
+        sum_sq = 0;
+        for (i = 0; i < tasks; i++)
+        {
+            total += w[i].ops;
+            sum_sq += (double)w[i].ops * w[i].ops;
+        }
+        jain = sum_sq ? (double)total * total / (tasks * sum_sq) : 0;
+        printf("%s tasks %d ops %lld switches_per_s %.0f slice_us %.1f fairness %.4f\n",
+               settings[s].name, tasks, total, (double)stats.switches / seconds,
+               stats.slice_ns / 1e3, jain);
+    }
+
+    // cleanup
+    free(w);
+    free(threads);
+    close(devfd);
+    return 0;
+}
@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pcontainer.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+int devfd;
+int use_ring = 0;
+int containers = 100, tasks = 4;
+volatile int done = 0;
+pid_t *tids;
+pthread_barrier_t barrier;
+
+/**
+ * monotonic clock in nanoseconds.
+ */
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * One task of the setup. In create mode it joins its container itself, in
+ * ring mode it only publishes its tid and waits to be attached. Either way
+ * it idles in its container until the measurement is over.
+ */
+void *thread_body(void *x)
+{
+    int i = *(int *)x;
+    int cid = i / tasks;
+
+    tids[i] = syscall(SYS_gettid);
+    pthread_barrier_wait(&barrier);
+    if (!use_ring)
+        pcontainer_create(devfd, cid);
+    while (!done)
+        pause();
+    pcontainer_delete(devfd, cid);
+    return NULL;
+}
+
+/**
+ * Attach every task to its container through the command ring, submitting
+ * whenever the ring is full.
+ */
+static void ring_setup(struct processor_container_ring *ring)
+{
+    struct processor_container_cqe cqe;
+    int i;
+
+    for (i = 0; i < containers * tasks; i++)
+    {
+        while (pcontainer_ring_queue(ring, PCONTAINER_OP_ATTACH, i / tasks, tids[i], i))
+        {
+            pcontainer_ring_submit(devfd);
+            while (pcontainer_ring_reap(ring, &cqe))
+                if (cqe.res < 0)
+                    fprintf(stderr, "attach of task %llu failed: %lld\n", cqe.user_data, cqe.res);
+        }
+    }
+    pcontainer_ring_submit(devfd);
+    while (pcontainer_ring_reap(ring, &cqe))
+        if (cqe.res < 0)
+            fprintf(stderr, "attach of task %llu failed: %lld\n", cqe.user_data, cqe.res);
+}
+
+/**
+ * Wait until every container reports all of its tasks.
+ */
+static void wait_populated(void)
+{
+    struct processor_container_stats stats;
+    int i;
+
+    for (i = 0; i < containers; i++)
+        while (pcontainer_stats(devfd, i, &stats) || stats.nr_tasks < (__u64)tasks)
+            sched_yield();
+}
+
+/**
+ * usage: ./ring_setup [create|ring] [containers] [tasks]
+ *
+ * Measures the time to set up containers x tasks, either by every task
+ * calling pcontainer_create() or by one thread attaching all of them
+ * through the command ring.
+ */
+int main(int argc, char *argv[])
+{
+    int i, *index;
+    long long start, elapsed;
+    struct processor_container_ring *ring = NULL;
+    pthread_t *threads;
+
+    if (argc > 1)
+        use_ring = !strcmp(argv[1], "ring");
+    if (argc > 2)
+        containers = atoi(argv[2]);
+    if (argc > 3)
+        tasks = atoi(argv[3]);
+
+    devfd = pcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed\n");
+        exit(1);
+    }
+    pcontainer_init(devfd);
+    if (use_ring && !(ring = pcontainer_ring_init(devfd)))
+    {
+        fprintf(stderr, "Ring mmap failed\n");
+        exit(1);
+    }
+
+    index = (int *) calloc(containers * tasks, sizeof(int));
+    tids = (pid_t *) calloc(containers * tasks, sizeof(pid_t));
+    threads = (pthread_t *) calloc(containers * tasks, sizeof(pthread_t));
+    pthread_barrier_init(&barrier, NULL, containers * tasks + 1);
+    for (i = 0; i < containers * tasks; i++)
+    {
+        index[i] = i;
+        pthread_create(&threads[i], NULL, thread_body, &index[i]);
+    }
+
+    pthread_barrier_wait(&barrier);
+    start = now_ns();
+    if (use_ring)
+        ring_setup(ring);
+    wait_populated();
+    elapsed = now_ns() - start;
+
+    printf("%s containers %d tasks %d setup_us %.1f\n", use_ring ? "ring" : "create",
+           containers, tasks, elapsed / 1e3);
+
+    // cleanup
+    done = 1;
+    for (i = 0; i < containers * tasks; i++)
+        pthread_kill(threads[i], SIGPROF);
+    for (i = 0; i < containers * tasks; i++)
+        pthread_join(threads[i], NULL);
+    free(index);
+    free(tids);
+    free(threads);
+    close(devfd);
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pcontainer.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+int devfd;
+
+/**
+ * monotonic clock in nanoseconds.
+ */
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Measures create/delete latency of a fresh container while a growing number
+ * of other containers stay alive. The calling thread is the only member of
+ * every container it creates, so none of the calls put it to sleep.
+ */
+int main(int argc, char *argv[])
+{
+    int live = 0, target, i;
+    int iterations = 1000;
+    int max_containers = 100000;
+    long long start, create_ns, delete_ns;
+
+    if (argc > 1)
+        max_containers = atoi(argv[1]);
+    if (argc > 2)
+        iterations = atoi(argv[2]);
+
+    devfd = pcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed\n");
+        exit(1);
+    }
+
+    printf("live_containers create_ns delete_ns\n");
+    for (target = 10; target <= max_containers; target *= 10)
+    {
+        // grow the population of live containers up to the target.
+        for (; live < target; live++)
+            pcontainer_create(devfd, live);
+
+        // create and destroy fresh containers with cids above the live ones.
+        create_ns = delete_ns = 0;
+        for (i = 0; i < iterations; i++)
+        {
+            start = now_ns();
+            pcontainer_create(devfd, max_containers + i);
+            create_ns += now_ns() - start;
+            start = now_ns();
+            pcontainer_delete(devfd, max_containers + i);
+            delete_ns += now_ns() - start;
+        }
+        printf("%d %lld %lld\n", live, create_ns / iterations, delete_ns / iterations);
+    }
+
+    // cleanup
+    for (i = 0; i < live; i++)
+        pcontainer_delete(devfd, i);
+    close(devfd);
+    return 0;
+}
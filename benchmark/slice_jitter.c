@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include <pcontainer.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#define MAX_SLICES 100000
+#define GAP_NS 20000
+
+int devfd;
+volatile int running = 1;
+long long quantum = -1;
+
+struct slices
+{
+    int count;
+    long long len[MAX_SLICES];
+};
+
+/**
+ * monotonic clock in nanoseconds.
+ */
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Spins on the clock and records every stretch of uninterrupted execution.
+ * A gap longer than GAP_NS between two reads means the task was switched out.
+ */
+void *thread_body(void *x)
+{
+    struct slices *s = (struct slices *)x;
+    long long start, last, t;
+
+    pcontainer_create(devfd, 0);
+    if (quantum >= 0)
+        pcontainer_set_quantum(devfd, 0, quantum);
+    start = last = now_ns();
+    while (running)
+    {
+        t = now_ns();
+        if (t - last > GAP_NS)
+        {
+            if (s->count < MAX_SLICES)
+                s->len[s->count++] = last - start;
+            start = t;
+        }
+        last = t;
+    }
+    pcontainer_delete(devfd, 0);
+    return NULL;
+}
+
+/**
+ * Runs a number of spinning tasks in one container and reports the mean and
+ * standard deviation of their time slices together with the system time the
+ * process spent, which is dominated by the switch path.
+ */
+int main(int argc, char *argv[])
+{
+    int i, j, tasks = 2, seconds = 5, n = 0;
+    double mean = 0, var = 0;
+    struct slices *s;
+    struct rusage usage;
+    pthread_t *threads;
+
+    if (argc > 1)
+        tasks = atoi(argv[1]);
+    if (argc > 2)
+        seconds = atoi(argv[2]);
+    if (argc > 3)
+        quantum = atoll(argv[3]);
+
+    devfd = pcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed\n");
+        exit(1);
+    }
+    pcontainer_init(devfd);
+
+    s = (struct slices *) calloc(tasks, sizeof(struct slices));
+    threads = (pthread_t *) calloc(tasks, sizeof(pthread_t));
+    for (i = 0; i < tasks; i++)
+        pthread_create(&threads[i], NULL, thread_body, &s[i]);
+    sleep(seconds);
+    running = 0;
+    for (i = 0; i < tasks; i++)
+        pthread_join(threads[i], NULL);
+
+    // the first slice of every task starts before the container rotates.
+    for (i = 0; i < tasks; i++)
+        for (j = 1; j < s[i].count; j++, n++)
+            mean += s[i].len[j];
+    mean = n ? mean / n : 0;
+    for (i = 0; i < tasks; i++)
+        for (j = 1; j < s[i].count; j++)
+            var += (s[i].len[j] - mean) * (s[i].len[j] - mean);
+    var = n ? var / n : 0;
+
+    getrusage(RUSAGE_SELF, &usage);
+    printf("slices %d mean_ns %.0f stddev_ns %.0f user_s %ld.%06ld sys_s %ld.%06ld\n",
+           n, mean, sqrt(var),
+           usage.ru_utime.tv_sec, usage.ru_utime.tv_usec,
+           usage.ru_stime.tv_sec, usage.ru_stime.tv_usec);
+
+    // cleanup
+    free(s);
+    free(threads);
+    close(devfd);
+    return 0;
+}
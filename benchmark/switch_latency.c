@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pcontainer.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define MEASURE_CID 0x7fffffff
+
+int devfd;
+pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+int target = 0, live = 0, done = 0;
+
+/**
+ * monotonic clock in nanoseconds.
+ */
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Background thread that owns the idle containers. It grows their number
+ * to whatever the measuring thread asks for and removes them at the end.
+ */
+void *populate_body(void *x)
+{
+    int i;
+
+    pthread_mutex_lock(&mutex);
+    while (!done)
+    {
+        for (; live < target; live++)
+            pcontainer_create(devfd, live);
+        pthread_cond_broadcast(&cond);
+        pthread_cond_wait(&cond, &mutex);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    for (i = 0; i < live; i++)
+        pcontainer_delete(devfd, i);
+    return NULL;
+}
+
+/**
+ * Measures the cost of the context switch ioctl issued by the only member
+ * of a container while the number of other live containers grows.
+ */
+int main(int argc, char *argv[])
+{
+    int i, step;
+    int iterations = 100000;
+    int max_containers = 100000;
+    long long start;
+    pthread_t populate;
+
+    if (argc > 1)
+        max_containers = atoi(argv[1]);
+    if (argc > 2)
+        iterations = atoi(argv[2]);
+
+    devfd = pcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed\n");
+        exit(1);
+    }
+
+    pcontainer_create(devfd, MEASURE_CID);
+    pthread_create(&populate, NULL, populate_body, NULL);
+
+    printf("live_containers switch_ns\n");
+    for (step = 10; step <= max_containers; step *= 10)
+    {
+        // let the background thread grow the population and wait for it.
+        pthread_mutex_lock(&mutex);
+        target = step;
+        pthread_cond_broadcast(&cond);
+        while (live < target)
+            pthread_cond_wait(&cond, &mutex);
+        pthread_mutex_unlock(&mutex);
+
+        start = now_ns();
+        for (i = 0; i < iterations; i++)
+            pcontainer_context_switch_handler(devfd, MEASURE_CID);
+        printf("%d %lld\n", live, (now_ns() - start) / iterations);
+    }
+
+    // cleanup
+    pthread_mutex_lock(&mutex);
+    done = 1;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&mutex);
+    pthread_join(populate, NULL);
+    pcontainer_delete(devfd, MEASURE_CID);
+    close(devfd);
+    return 0;
+}
@@ -0,0 +1,109 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pcontainer.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#define CHURN_CID_BASE 0x40000000
+
+int devfd;
+volatile int running;
+long long *switches;
+
+/**
+ * Worker that owns a private container and issues switch ioctls as fast as
+ * it can until told to stop.
+ */
+void *switch_body(void *x)
+{
+    long id = (long)x;
+    long long count = 0;
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(id % sysconf(_SC_NPROCESSORS_ONLN), &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+    pcontainer_create(devfd, id);
+    while (running)
+    {
+        pcontainer_context_switch_handler(devfd, id);
+        count++;
+    }
+    pcontainer_delete(devfd, id);
+    switches[id] = count;
+    return NULL;
+}
+
+/**
+ * Creates and destroys containers in a loop, so switches also have to
+ * coexist with create/delete traffic.
+ */
+void *churn_body(void *x)
+{
+    int cid = CHURN_CID_BASE;
+    while (running)
+    {
+        pcontainer_create(devfd, cid);
+        pcontainer_delete(devfd, cid);
+        cid++;
+    }
+    return NULL;
+}
+
+/**
+ * Measures aggregate switch throughput with 1, 2, 4, ... threads, each in
+ * its own container, while one more thread churns containers.
+ */
+int main(int argc, char *argv[])
+{
+    long i, threads;
+    long long total;
+    int seconds = 2;
+    int max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    pthread_t *workers, churn;
+
+    if (argc > 1)
+        max_threads = atoi(argv[1]);
+    if (argc > 2)
+        seconds = atoi(argv[2]);
+
+    devfd = pcontainer_open();
+    if (devfd < 0)
+    {
+        fprintf(stderr, "Device open failed\n");
+        exit(1);
+    }
+
+    workers = (pthread_t *) calloc(max_threads, sizeof(pthread_t));
+    switches = (long long *) calloc(max_threads, sizeof(long long));
+
+    printf("threads switches_per_sec\n");
+    for (threads = 1; threads <= max_threads; threads *= 2)
+    {
+        running = 1;
+        pthread_create(&churn, NULL, churn_body, NULL);
+        for (i = 0; i < threads; i++)
+            pthread_create(&workers[i], NULL, switch_body, (void *)i);
+        sleep(seconds);
+        running = 0;
+        for (i = 0; i < threads; i++)
+            pthread_join(workers[i], NULL);
+        pthread_join(churn, NULL);
+
+        total = 0;
+        for (i = 0; i < threads; i++)
+            total += switches[i];
+        printf("%ld %lld\n", threads, total / seconds);
+    }
+
+    // cleanup
+    free(workers);
+    free(switches);
+    close(devfd);
+    return 0;
+}
@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MAX_PIDS 64
+
+/**
+ * Reads the pcontainer tracepoints and prints a per-container timeline and
+ * a summary of switch latencies.
+ *
+ * usage: ./trace_summary [-v] <seconds>   record from tracefs for a while
+ *        ./trace_summary [-v] -           analyze a saved trace from stdin
+ *
+ * -v prints every slice of the timeline instead of per-task totals.
+ */
+
+struct container
+{
+    unsigned long long cid;
+    int running;            // pid holding the slice, 0 if unknown
+    double since;           // when it got the slice
+    double out;             // last switch-out, -1 if none pending
+    int slices;
+    int npids;
+    int pids[MAX_PIDS];
+    double runtime[MAX_PIDS];
+};
+
+struct samples
+{
+    int count, size;
+    double *v;
+};
+
+struct container *containers;
+int ncontainers;
+struct samples handoff, wakeup;
+int verbose;
+const char *tracefs;
+
+static struct container *find_container(unsigned long long cid)
+{
+    int i;
+    for (i = 0; i < ncontainers; i++)
+        if (containers[i].cid == cid)
+            return &containers[i];
+    containers = realloc(containers, (ncontainers + 1) * sizeof(struct container));
+    memset(&containers[ncontainers], 0, sizeof(struct container));
+    containers[ncontainers].cid = cid;
+    containers[ncontainers].out = -1;
+    return &containers[ncontainers++];
+}
+
+static void add_sample(struct samples *s, double v)
+{
+    if (s->count == s->size)
+    {
+        s->size = s->size ? s->size * 2 : 1024;
+        s->v = realloc(s->v, s->size * sizeof(double));
+    }
+    s->v[s->count++] = v;
+}
+
+/**
+ * close the slice the running task of a container has been holding.
+ */
+static void end_slice(struct container *c, double t)
+{
+    int i;
+    if (!c->running)
+        return;
+    for (i = 0; i < c->npids && c->pids[i] != c->running; i++)
+        ;
+    if (i == c->npids && c->npids < MAX_PIDS)
+        c->pids[c->npids++] = c->running;
+    if (i < c->npids)
+        c->runtime[i] += t - c->since;
+    if (verbose)
+        printf("cid %llu pid %d ran %.6f-%.6f (%.1f us)\n",
+               c->cid, c->running, c->since, t, (t - c->since) * 1e6);
+    c->slices++;
+    c->running = 0;
+}
+
+static void begin_slice(struct container *c, int pid, double t)
+{
+    c->running = pid;
+    c->since = t;
+}
+
+/**
+ * parse one line of the trace, e.g.
+ *   benchmark-1234  [002] d... 1234.567890: pcontainer_switch_out: cid=0 pid=1234
+ */
+static void parse_line(char *line)
+{
+    char *event, *ts, *fields;
+    unsigned long long cid, latency = 0;
+    int pid;
+    double t;
+    struct container *c;
+
+    if (!(event = strstr(line, ": pcontainer_")))
+        return;
+    *event = '\0';
+    event += 2;
+    if (!(ts = strrchr(line, ' ')))
+        return;
+    t = atof(ts + 1);
+    if (!(fields = strchr(event, ':')))
+        return;
+    *fields++ = '\0';
+    if (sscanf(fields, " cid=%llu pid=%d latency_ns=%llu", &cid, &pid, &latency) < 2)
+        return;
+    c = find_container(cid);
+
+    if (!strcmp(event, "pcontainer_create"))
+    {
+        // only the creator of a container starts running right away.
+        if (!c->running && c->out < 0)
+            begin_slice(c, pid, t);
+    }
+    else if (!strcmp(event, "pcontainer_switch_out") || !strcmp(event, "pcontainer_delete"))
+    {
+        if (c->running == pid)
+        {
+            end_slice(c, t);
+            c->out = t;
+        }
+    }
+    else if (!strcmp(event, "pcontainer_switch_in"))
+    {
+        add_sample(&wakeup, latency / 1e3);
+        if (c->out >= 0)
+            add_sample(&handoff, (t - c->out) * 1e6);
+        c->out = -1;
+        end_slice(c, t);
+        begin_slice(c, pid, t);
+    }
+}
+
+static int compare(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void summarize(const char *name, struct samples *s)
+{
+    double sum = 0;
+    int i;
+    if (!s->count)
+    {
+        printf("%s: no samples\n", name);
+        return;
+    }
+    qsort(s->v, s->count, sizeof(double), compare);
+    for (i = 0; i < s->count; i++)
+        sum += s->v[i];
+    printf("%s: n %d mean %.1f us p50 %.1f us p99 %.1f us max %.1f us\n", name, s->count,
+           sum / s->count, s->v[s->count / 2], s->v[s->count * 99 / 100], s->v[s->count - 1]);
+}
+
+/**
+ * write a value into a tracefs control file.
+ */
+static int tracefs_write(const char *file, const char *value)
+{
+    char path[256];
+    FILE *f;
+    snprintf(path, sizeof(path), "%s/%s", tracefs, file);
+    if (!(f = fopen(path, "w")))
+        return -1;
+    fputs(value, f);
+    return fclose(f);
+}
+
+int main(int argc, char *argv[])
+{
+    char line[1024], path[256];
+    FILE *in;
+    int i, j, seconds;
+
+    if (argc > 1 && !strcmp(argv[1], "-v"))
+    {
+        verbose = 1;
+        argc--;
+        argv++;
+    }
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: ./trace_summary [-v] <seconds>|-\n");
+        exit(1);
+    }
+
+    if (!strcmp(argv[1], "-"))
+        in = stdin;
+    else
+    {
+        seconds = atoi(argv[1]);
+        tracefs = access("/sys/kernel/tracing/trace", F_OK) ? "/sys/kernel/debug/tracing" : "/sys/kernel/tracing";
+        // a global clock makes timestamps comparable across CPUs.
+        tracefs_write("trace_clock", "mono");
+        tracefs_write("trace", "");
+        if (tracefs_write("events/pcontainer/enable", "1"))
+        {
+            fprintf(stderr, "Cannot enable pcontainer events under %s\n", tracefs);
+            exit(1);
+        }
+        sleep(seconds);
+        tracefs_write("events/pcontainer/enable", "0");
+        snprintf(path, sizeof(path), "%s/trace", tracefs);
+        if (!(in = fopen(path, "r")))
+        {
+            fprintf(stderr, "Cannot read %s\n", path);
+            exit(1);
+        }
+    }
+
+    while (fgets(line, sizeof(line), in))
+        parse_line(line);
+
+    for (i = 0; i < ncontainers; i++)
+    {
+        printf("container %llu: slices %d\n", containers[i].cid, containers[i].slices);
+        for (j = 0; j < containers[i].npids; j++)
+            printf("  pid %d ran %.3f ms\n", containers[i].pids[j], containers[i].runtime[j] * 1e3);
+    }
+    summarize("switch-out to switch-in", &handoff);
+    summarize("wakeup to run", &wakeup);
+    return 0;
+}
@@ -40,10 +40,157 @@ struct processor_container_cmd
     __u64 cid;
 };
 
+struct processor_container_param
+{
+    __u64 cid;
+    __u64 value;
+};
+
+#define PCONTAINER_LATENCY_BUCKETS 16
+
+struct processor_container_stats
+{
+    __u64 cid;
+    __u64 nr_tasks;
+    __u64 switches;
+    __u64 wakeups;
+    __u64 runtime_ns;
+    // latency_hist[i] counts wakeup-to-run latencies below 2^i us,
+    // the last bucket also everything above
+    __u64 latency_hist[PCONTAINER_LATENCY_BUCKETS];
+    __u64 slice_ns;     // current time slice, moves around the quantum in adaptive mode
+};
+
+struct processor_container_migrate
+{
+    __u64 from;
+    __u64 to;
+    __s32 tid;
+    __u32 pad;
+};
+
+// CPUs a container may run on; an all-zero mask and node -1 lift the
+// restriction, a node alone means all of its CPUs
+#define PCONTAINER_MAX_CPUS 1024
+
+struct processor_container_cpus
+{
+    __u64 cid;
+    __s32 node;     // preferred NUMA node, -1 for none
+    __u32 pad;
+    __u64 mask[PCONTAINER_MAX_CPUS / 64];
+};
+
+// the device can be mapped read-only; it is an array of status entries,
+// one per live container of the file's namespace, PCONTAINER_STATUS_SLOTS
+// of them in the default namespace and as many as PCONTAINER_IOCTL_NEW_NS
+// returned in a private one, and PCONTAINER_IOCTL_CREATE and
+// PCONTAINER_IOCTL_CSWITCH return the slot of the caller's container;
+// SIGPROF from the module with si_code SI_KERNEL only ends a slice and may
+// be skipped while nobody waits, any other one means the slot may have
+// changed and the switch call has to be made
+#define PCONTAINER_STATUS_SLOTS 65536
+#define PCONTAINER_NO_SLOT PCONTAINER_STATUS_SLOTS
+
+struct processor_container_status
+{
+    __u64 cid;
+    __u32 nr_tasks;
+    __u32 concurrency;  // tasks allowed to run at once, nobody waits below it;
+                        // 0 for a gang container outside its turn
+};
+
+// mapping the device at PCONTAINER_RING_OFFSET gives the caller a ring of
+// its own: commands are queued at sq_tail, PCONTAINER_IOCTL_SUBMIT runs
+// everything up to it and posts one completion per command at cq_tail
+#define PCONTAINER_RING_ENTRIES 256
+#define PCONTAINER_RING_OFFSET 0x10000000
+
+#define PCONTAINER_OP_CREATE 1          // the submitter joins cid
+#define PCONTAINER_OP_DELETE 2          // the submitter leaves cid
+#define PCONTAINER_OP_SET_QUANTUM 3     // value is the slice in ns
+#define PCONTAINER_OP_SET_SHARES 4      // value is the CPU weight
+#define PCONTAINER_OP_ATTACH 5          // thread value joins cid
+#define PCONTAINER_OP_ATTACH_GROUP 6    // all threads of process value join cid
+#define PCONTAINER_OP_SET_CONCURRENCY 7 // value tasks may run at once
+#define PCONTAINER_OP_SET_GANG 8        // nonzero value enables gang mode
+#define PCONTAINER_OP_SET_ADAPTIVE 9    // nonzero value enables the adaptive slice
+#define PCONTAINER_OP_SET_STARVE 10     // value is the starvation threshold in ns
+#define PCONTAINER_OP_MIGRATE 11        // thread value moves from cid to container to
+
+struct processor_container_sqe
+{
+    __u64 op;
+    __u64 cid;
+    __u64 value;
+    __u64 user_data;    // copied into the completion
+    __u64 to;           // destination of PCONTAINER_OP_MIGRATE
+};
+
+struct processor_container_cqe
+{
+    __u64 user_data;
+    __s64 res;          // what the ioctl would have returned
+};
+
+struct processor_container_ring
+{
+    __u32 sq_head;      // advanced by the kernel
+    __u32 sq_tail;      // advanced by user space
+    __u32 cq_head;      // advanced by user space
+    __u32 cq_tail;      // advanced by the kernel
+    struct processor_container_sqe sq[PCONTAINER_RING_ENTRIES];
+    struct processor_container_cqe cq[PCONTAINER_RING_ENTRIES];
+};
+
+// after PCONTAINER_IOCTL_WATCH, reading the device returns whole event
+// records of the watched containers, oldest first, and poll reports POLLIN
+// while some are queued; the cid of the watch is a container or
+// PCONTAINER_WATCH_ALL, the value a mask of 1 << PCONTAINER_EVENT_*
+#define PCONTAINER_WATCH_ALL (~0ULL)
+
+#define PCONTAINER_EVENT_CREATED 1      // the container came into existence
+#define PCONTAINER_EVENT_DESTROYED 2    // its last task left
+#define PCONTAINER_EVENT_JOINED 3       // tid joined the container
+#define PCONTAINER_EVENT_LEFT 4         // tid left it, or exited
+#define PCONTAINER_EVENT_STARVED 5      // its members got no CPU for value ns,
+                                        // see PCONTAINER_IOCTL_SET_STARVE
+#define PCONTAINER_EVENT_LOST 6         // the queue was full, value events
+                                        // were dropped before this one
+
+struct processor_container_event
+{
+    __u64 cid;
+    __u64 time_ns;      // CLOCK_MONOTONIC when it happened
+    __u64 value;
+    __u32 type;
+    __s32 tid;          // in the pid namespace of the watcher, 0 if none
+};
+
 #define PCONTAINER_IOCTL_LOCK _IOWR('N', 0x43, struct processor_container_cmd)
 #define PCONTAINER_IOCTL_UNLOCK _IOWR('N', 0x44, struct processor_container_cmd)
 #define PCONTAINER_IOCTL_DELETE _IOWR('N', 0x45, struct processor_container_cmd)
 #define PCONTAINER_IOCTL_CREATE _IOWR('N', 0x46, struct processor_container_cmd)
 #define PCONTAINER_IOCTL_CSWITCH _IOWR('N', 0x47, struct processor_container_cmd)
+#define PCONTAINER_IOCTL_SET_QUANTUM _IOWR('N', 0x48, struct processor_container_param)
+#define PCONTAINER_IOCTL_SET_SHARES _IOWR('N', 0x49, struct processor_container_param)
+#define PCONTAINER_IOCTL_STATS _IOWR('N', 0x4a, struct processor_container_stats)
+#define PCONTAINER_IOCTL_SUBMIT _IO('N', 0x4b)
+#define PCONTAINER_IOCTL_ATTACH _IOW('N', 0x4c, struct processor_container_param)
+#define PCONTAINER_IOCTL_ATTACH_GROUP _IOW('N', 0x4d, struct processor_container_param)
+#define PCONTAINER_IOCTL_MIGRATE _IOW('N', 0x4e, struct processor_container_migrate)
+#define PCONTAINER_IOCTL_SET_CONCURRENCY _IOW('N', 0x4f, struct processor_container_param)
+#define PCONTAINER_IOCTL_SET_GANG _IOW('N', 0x50, struct processor_container_param)
+#define PCONTAINER_IOCTL_SET_CPUS _IOW('N', 0x51, struct processor_container_cpus)
+#define PCONTAINER_IOCTL_SET_ADAPTIVE _IOW('N', 0x52, struct processor_container_param)
+#define PCONTAINER_IOCTL_WATCH _IOW('N', 0x53, struct processor_container_param)
+#define PCONTAINER_IOCTL_SET_STARVE _IOW('N', 0x54, struct processor_container_param)
+// gives the calling file a namespace of its own: its cids are independent
+// of those of every other file, and so are the locks and the status table
+// behind them; returns the number of status entries; fails with EBUSY once
+// the file created, joined, changed, looked up or watched a container,
+// took a lock or mapped the status table in the namespace it has, or moved
+// already
+#define PCONTAINER_IOCTL_NEW_NS _IO('N', 0x55)
 
 #endif
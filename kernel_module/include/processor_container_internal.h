@@ -0,0 +1,330 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2016
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Kernel-private data structures shared by core.c and ioctl.c
+//
+////////////////////////////////////////////////////////////////////////
+
+#ifndef PROCESSOR_CONTAINER_INTERNAL_H
+#define PROCESSOR_CONTAINER_INTERNAL_H
+
+#include <linux/types.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/rcupdate.h>
+#include <linux/rhashtable.h>
+#include <linux/hashtable.h>
+#include <linux/hrtimer.h>
+#include <linux/wait.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/fs.h>
+#include <linux/poll.h>
+#include <linux/mm.h>
+#include <linux/cpumask.h>
+#include <linux/preempt.h>
+#include <linux/irq_work.h>
+#include <linux/llist.h>
+#include <linux/kref.h>
+#include <linux/workqueue.h>
+#include <linux/idr.h>
+#include <linux/kernel.h>
+
+#include "processor_container.h"
+
+/**
+ * Two link list nodes, one for container, one for tasks within container.
+ * Up to concurrency tasks of a container run at a time, the rest wait in
+ * line and get a running slot round robin as running ones yield. Gang
+ * containers instead run all of their members at once and take turns with
+ * the other gang containers as a whole. A member that blocks outside the
+ * module while holding a slot hands it to a waiting task and waits on
+ * blocked_head until it wakes up.
+ * Containers are additionally indexed by their full 64-bit cid in the
+ * table of their namespace, so create/delete find them without walking
+ * the list. Every file starts in init_container_ns; PCONTAINER_IOCTL_NEW_NS
+ * gives an unused one a namespace of its own, whose cids, lock ids, table
+ * and lock it shares with nobody else.
+ * Every task node is also hashed by its task_struct in task_table and points
+ * back to its container, so a task finds its own container in O(1).
+ *
+ * Locking: both indexes are read under RCU. The lock of a namespace
+ * serializes inserts/removals in its table and list, and the lock of a
+ * task_table bucket those in the bucket. Each container's task lists and
+ * counters are protected by its own lock, which nests outside the index
+ * locks. Nodes are freed after a grace period, and a container is marked
+ * dead before it leaves its namespace.
+ * A task node is only ever removed by its own task, or by task_reap_work()
+ * once the task exited, which lets a task use its node without a lookup
+ * when it wakes up again. Other tasks may add
+ * nodes for it (attach) or move its node between containers (migrate);
+ * migration is the only path holding two container locks, taken in
+ * address order. gang_lock protects the gang rotation and nests inside the
+ * container locks.
+ */
+struct container_list_node;
+
+/**
+ * Per-CPU statistics of a container, summed up when they are read.
+ */
+struct container_stats {
+    u64 switches;
+    u64 wakeups;
+    u64 runtime_ns;
+    u64 latency_hist[PCONTAINER_LATENCY_BUCKETS];//wakeup-to-run latency
+};
+
+struct task_list_node {
+    struct list_head list;
+    struct hlist_node hash;//linkage in task_table, keyed by task_id
+    struct task_struct* task_id;
+    struct pid *pid;//of task_id, still there for events after the task exited
+    struct container_list_node* container;
+    int orig_nice;//nice level to restore when leaving a weighted container
+    u64 exec_mark;//sum_exec_runtime at the last accounting
+    u64 runtime_ns;//CPU time used while in the container
+    u64 woken_at;//when the task was last handed the slice, 0 once it ran
+    bool park;//attached by another task, sleep at the next switch call
+    bool running;//on running_head, holding one of the container's slots
+    bool sleeping;//blocked outside the module since it last held a slot
+    u64 cpus_seq;//placement generation of its container it last applied
+    bool blocked;//on blocked_head, gave its slot away while sleeping
+    bool expired;//its slice timer fired since it last got a slot
+    bool removed;//off its container for good, which may be freed already
+#ifdef CONFIG_PREEMPT_NOTIFIERS
+    struct preempt_notifier notifier;//tells when the task blocks and wakes up
+    bool notifier_registered;//only the task itself can register it
+    struct irq_work block_irq;//gets the block handling out of the scheduler
+    struct work_struct block_work;//gives the slot away
+#endif
+    struct llist_node reap;//linkage in reap_list once the task exited
+    struct hrtimer timer;//signals the task when its slice is over
+    wait_queue_head_t wait;//the task sleeps here while it waits for a slot
+    struct rcu_head rcu;
+};
+
+/**
+ * A namespace of containers. It lives until its files are closed and its
+ * last container is freed; init_container_ns is not counted and lives as
+ * long as the module.
+ */
+struct container_ns {
+    struct rhashtable table;//its containers by cid
+    struct rhashtable locks;//its PCONTAINER_IOCTL_LOCK objects by id, see lock.c
+    struct processor_container_status *status;//mapped read-only by its files, see status.c
+    unsigned int status_slots;//entries in status
+    struct ida status_ida;//hands out the entries
+    struct list_head list;//its containers, read under RCU
+    spinlock_t lock;//serializes inserts/removals in table and list
+    struct kref ref;//held by its files, its containers and its locks
+    u32 id;//shown in debugfs, 0 for init_container_ns
+    struct list_head link;//linkage in ns_list
+    struct llist_node free;//linkage in ns_free_list once unused
+    struct rcu_head rcu;
+};
+
+struct container_list_node {
+    struct list_head list;//linkage in the list of its namespace
+    struct rhash_head hash;//linkage in the table of its namespace
+    struct container_ns *ns;
+    __u64 cid;
+    spinlock_t lock;//protects everything below
+    bool dead;//no task left, already removed from its namespace
+    struct list_head running_head;//task_list_nodes holding a running slot
+    struct list_head task_head;//waiting task_list_nodes, the next to run first
+    struct list_head blocked_head;//task_list_nodes asleep outside the module
+    int nr_tasks;//on any of the lists
+    int nr_running;
+    int concurrency;//running slots
+    unsigned int slot;//entry in the status table, PCONTAINER_NO_SLOT if it was full
+    __u64 quantum_ns;//0 disables the quantum timer
+    __u64 slice_ns;//slice the timers are armed with, quantum_ns unless adaptive
+    bool adaptive;//slice_ns follows how much of it the tasks use
+    __u64 shares;//CPU weight, 1024 is nice 0; 0 leaves member priorities alone
+    bool gang;//in gang_list, all members run together during its turn
+    bool gang_on;//its turn, concurrency does not apply
+    struct list_head gang_link;//linkage in gang_list, protected by gang_lock
+    cpumask_var_t cpus;//where members run, empty for anywhere
+    u64 cpus_seq;//bumped on every placement change, 0 if never placed
+    __u64 starve_ns;//members without CPU for this long are reported, 0 never
+    u64 starve_exec;//CPU time of the slot holders at the last starvation check
+    u64 starve_since;//when starve_exec last moved
+    bool starved;//reported, until its members run again
+    struct container_stats __percpu *stats;
+    struct rcu_head rcu;
+};
+
+/**
+ * Number of running slots of a container. A gang container has room for
+ * every member during its turn and for none outside it.
+ * Must be called with container->lock held.
+ */
+static inline int container_slots(struct container_list_node *container)
+{
+    if (container->gang)
+        return container->gang_on ? INT_MAX : 0;
+    return container->concurrency;
+}
+
+struct container_ring;
+struct container_watch;
+
+/**
+ * State of an open file of the device, in filp->private_data.
+ */
+struct container_file {
+    struct container_ring *ring;//created by the first mmap at PCONTAINER_RING_OFFSET
+    struct container_watch *watch;//created by the first PCONTAINER_IOCTL_WATCH
+    struct container_ns *ns;//where its cids live, NULL until first used, see container_file_ns()
+};
+
+static const struct rhashtable_params container_table_params = {
+    .key_len             = sizeof(__u64),
+    .key_offset          = offsetof(struct container_list_node, cid),
+    .head_offset         = offsetof(struct container_list_node, hash),
+    .automatic_shrinking = true,
+};
+
+#define TASK_TABLE_BITS 10
+#define PCONTAINER_ADAPTIVE_RANGE 8//an adaptive slice stays within quantum / 8 ... quantum * 8
+
+extern unsigned long quantum_ns;
+extern bool block_aware;
+extern bool handoff;
+extern unsigned long starve_check_us;
+extern unsigned int ns_status_slots;
+extern int nr_watches;
+extern struct container_ns init_container_ns;
+extern struct list_head ns_list;
+extern struct kmem_cache *container_cache, *task_cache;
+extern DECLARE_HASHTABLE(task_table, TASK_TABLE_BITS);
+extern spinlock_t task_table_locks[1 << TASK_TABLE_BITS];
+
+/**
+ * Lock of the task_table bucket of task, inserts and removals take it.
+ */
+static inline spinlock_t *task_table_lock(struct task_struct *task)
+{
+    return &task_table_locks[hash_min((unsigned long)task, TASK_TABLE_BITS)];
+}
+
+void container_ns_put(struct container_ns *ns);
+
+/**
+ * Pin a namespace for a container of it. init_container_ns is never
+ * released, so its containers skip the shared counter.
+ */
+static inline void container_ns_get(struct container_ns *ns)
+{
+    if (ns != &init_container_ns)
+        kref_get(&ns->ref);
+}
+
+/**
+ * Namespace of a file. A file that has not used one yet settles in
+ * init_container_ns here, after which PCONTAINER_IOCTL_NEW_NS fails, so
+ * whatever it creates stays reachable through it.
+ */
+static inline struct container_ns *container_file_ns(struct file *filp)
+{
+    struct container_file *file = filp->private_data;
+    struct container_ns *ns = smp_load_acquire(&file->ns);
+    if (ns)
+        return ns;
+    //a racing PCONTAINER_IOCTL_NEW_NS either came first or fails
+    cmpxchg(&file->ns, NULL, &init_container_ns);
+    return READ_ONCE(file->ns);
+}
+
+long processor_container_new_ns(struct file *filp);
+int processor_container_ns_init(void);
+void processor_container_ns_exit(void);
+
+struct container_list_node *container_lookup_lock(struct container_ns *ns, __u64 cid);
+int container_create(struct container_ns *ns, __u64 cid);
+int container_delete(struct container_ns *ns, __u64 cid);
+int container_attach(struct container_ns *ns, __u64 cid, pid_t tid);
+int container_attach_group(struct container_ns *ns, __u64 cid, pid_t tgid);
+int container_migrate(struct container_ns *ns, __u64 from, __u64 to, pid_t tid);
+int container_set_quantum(struct container_ns *ns, __u64 cid, __u64 value);
+int container_set_shares(struct container_ns *ns, __u64 cid, __u64 value);
+int container_set_concurrency(struct container_ns *ns, __u64 cid, __u64 value);
+int container_set_gang(struct container_ns *ns, __u64 cid, __u64 value);
+int container_set_adaptive(struct container_ns *ns, __u64 cid, __u64 value);
+int container_set_starve(struct container_ns *ns, __u64 cid, __u64 value);
+int container_set_cpus(struct container_ns *ns, __u64 cid, const struct cpumask *cpus);
+void processor_container_gang_init(void);
+void processor_container_gang_exit(void);
+void processor_container_block_init(void);
+void processor_container_block_exit(void);
+int processor_container_reap_init(void);
+void processor_container_reap_exit(void);
+int container_switch_current(void);
+void container_signal_switch(struct task_struct *task);
+
+long processor_container_lock(struct container_ns *ns, struct processor_container_cmd __user *user_cmd);
+long processor_container_unlock(struct container_ns *ns, struct processor_container_cmd __user *user_cmd);
+bool container_task_defer_switch(void);
+void container_task_drop_locks(struct task_struct *task);
+int container_ns_locks_init(struct container_ns *ns);
+void container_ns_locks_destroy(struct container_ns *ns);
+void processor_container_lock_exit(void);
+
+void container_status_alloc(struct container_list_node *container);
+void container_status_free(struct container_list_node *container);
+void container_status_update(struct container_list_node *container);
+int processor_container_mmap(struct file *filp, struct vm_area_struct *vma);
+int processor_container_ring_mmap(struct file *filp, struct vm_area_struct *vma);
+long processor_container_submit(struct file *filp);
+int processor_container_open(struct inode *inode, struct file *filp);
+int processor_container_release(struct inode *inode, struct file *filp);
+int container_ns_status_init(struct container_ns *ns, unsigned int slots);
+void container_ns_status_destroy(struct container_ns *ns);
+
+void container_event_post(struct container_list_node *container, __u32 type, struct task_list_node *task, __u64 value);
+long processor_container_watch(struct file *filp, struct processor_container_param __user *user_param);
+ssize_t processor_container_read(struct file *filp, char __user *buf, size_t count, loff_t *ppos);
+unsigned int processor_container_poll(struct file *filp, struct poll_table_struct *wait);
+void container_watch_free(struct container_watch *watch);
+void container_ring_free(struct container_ring *ring);
+void processor_container_event_exit(void);
+
+/**
+ * Report an event of a container to the files watching it. Costs a single
+ * load while nobody watches. Must be called with container->lock held.
+ */
+static inline void container_event(struct container_list_node *container, __u32 type, struct task_list_node *task, __u64 value)
+{
+    if (READ_ONCE(nr_watches))
+        container_event_post(container, type, task, value);
+}
+
+int processor_container_stats(struct container_ns *ns, struct processor_container_stats __user *user_stats);
+int processor_container_stats_init(void);
+void processor_container_stats_exit(void);
+
+#endif
@@ -0,0 +1,110 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2016
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Tracepoints of Processor Container, found under
+//     /sys/kernel/debug/tracing/events/pcontainer/
+//
+////////////////////////////////////////////////////////////////////////
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM pcontainer
+
+#if !defined(PROCESSOR_CONTAINER_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define PROCESSOR_CONTAINER_TRACE_H
+
+#include <linux/sched.h>
+#include <linux/tracepoint.h>
+
+DECLARE_EVENT_CLASS(pcontainer_task,
+
+    TP_PROTO(__u64 cid, struct task_struct *task),
+
+    TP_ARGS(cid, task),
+
+    TP_STRUCT__entry(
+        __field(__u64, cid)
+        __field(pid_t, pid)
+    ),
+
+    TP_fast_assign(
+        __entry->cid = cid;
+        __entry->pid = task->pid;
+    ),
+
+    TP_printk("cid=%llu pid=%d", __entry->cid, __entry->pid)
+);
+
+//a task joined a container, creating it if it was the first one
+DEFINE_EVENT(pcontainer_task, pcontainer_create,
+    TP_PROTO(__u64 cid, struct task_struct *task),
+    TP_ARGS(cid, task));
+
+//a task left a container
+DEFINE_EVENT(pcontainer_task, pcontainer_delete,
+    TP_PROTO(__u64 cid, struct task_struct *task),
+    TP_ARGS(cid, task));
+
+//the running task gave up the slice
+DEFINE_EVENT(pcontainer_task, pcontainer_switch_out,
+    TP_PROTO(__u64 cid, struct task_struct *task),
+    TP_ARGS(cid, task));
+
+//a task was handed the slice and woken up
+DEFINE_EVENT(pcontainer_task, pcontainer_wakeup,
+    TP_PROTO(__u64 cid, struct task_struct *task),
+    TP_ARGS(cid, task));
+
+//a woken task is running again, latency_ns after its wakeup
+TRACE_EVENT(pcontainer_switch_in,
+
+    TP_PROTO(__u64 cid, struct task_struct *task, u64 latency_ns),
+
+    TP_ARGS(cid, task, latency_ns),
+
+    TP_STRUCT__entry(
+        __field(__u64, cid)
+        __field(pid_t, pid)
+        __field(u64, latency_ns)
+    ),
+
+    TP_fast_assign(
+        __entry->cid = cid;
+        __entry->pid = task->pid;
+        __entry->latency_ns = latency_ns;
+    ),
+
+    TP_printk("cid=%llu pid=%d latency_ns=%llu", __entry->cid, __entry->pid,
+              (unsigned long long)__entry->latency_ns)
+);
+
+#endif
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE processor_container_trace
+#include <trace/define_trace.h>
@@ -43,15 +43,23 @@
 #include <linux/poll.h>
 #include <linux/mutex.h>
 
-extern long processor_container_lock(struct processor_container_cmd __user *user_cmd);
-extern long processor_container_unlock(struct processor_container_cmd __user *user_cmd);
 extern long processor_container_ioctl(struct file *filp, unsigned int cmd, unsigned long arg);
+extern int processor_container_mmap(struct file *filp, struct vm_area_struct *vma);
+extern int processor_container_open(struct inode *inode, struct file *filp);
+extern int processor_container_release(struct inode *inode, struct file *filp);
+extern ssize_t processor_container_read(struct file *filp, char __user *buf, size_t count, loff_t *ppos);
+extern unsigned int processor_container_poll(struct file *filp, struct poll_table_struct *wait);
 extern int processor_container_init(void);
 extern void processor_container_exit(void);
 
 static const struct file_operations processor_container_fops = {
     .owner                = THIS_MODULE,
     .unlocked_ioctl       = processor_container_ioctl,
+    .mmap                 = processor_container_mmap,
+    .open                 = processor_container_open,
+    .release              = processor_container_release,
+    .read                 = processor_container_read,
+    .poll                 = processor_container_poll,
 };
 
 struct miscdevice processor_container_dev = {
@@ -46,29 +46,39 @@
 
 #include <linux/list.h>
 
+#include "processor_container_internal.h"
+
 extern struct miscdevice processor_container_dev;
 
-/**
- * My define of two structures: two link list nodes, one for container, one for tasks within container
- * I use round robin for both container and in-container task arrangement.
- * the data structure is a 2-d linklist, outer one for containers, inner one for tasks.
- * and two global variables: one for the entry of the outer linklist, one for the head of the working container  
- */
-struct task_list_node {
-    struct list_head list;
-    struct task_struct* task_id;
-};
-
-struct container_list_node {
-    struct list_head list;
-    int cid;
-    struct list_head* task_head;//should be the head of a linklist of task_list_node
-    struct list_head* running_task;//should be the executing front
-};
 //global variables define here
-struct list_head *container_list_head;
-struct list_head *working_container;
-struct mutex *container_lock, *switch_lock;
+struct kmem_cache *container_cache, *task_cache;
+DEFINE_HASHTABLE(task_table, TASK_TABLE_BITS);
+spinlock_t task_table_locks[1 << TASK_TABLE_BITS];
+
+//default time slice of a new container, see PCONTAINER_IOCTL_SET_QUANTUM
+unsigned long quantum_ns = 1000000;
+module_param(quantum_ns, ulong, 0644);
+MODULE_PARM_DESC(quantum_ns, "Default container time slice in nanoseconds, 0 leaves rotation to user space");
+
+//hand the slot of a member that blocks to a waiting one, see task_block_work()
+bool block_aware = true;
+module_param(block_aware, bool, 0644);
+MODULE_PARM_DESC(block_aware, "Rotate past container members that block outside the module");
+
+//wake the next task of a container with a sync wakeup, see container_handoff()
+bool handoff = true;
+module_param(handoff, bool, 0644);
+MODULE_PARM_DESC(handoff, "Hand the CPU of a switching task straight to the next one");
+
+//how often starving containers are looked for, see container_starve_check()
+unsigned long starve_check_us = 1000;
+module_param(starve_check_us, ulong, 0644);
+MODULE_PARM_DESC(starve_check_us, "Interval of the starvation check in microseconds while somebody watches for it");
+
+//status table entries of a new private namespace, see processor_container_new_ns()
+unsigned int ns_status_slots = 1024;
+module_param(ns_status_slots, uint, 0644);
+MODULE_PARM_DESC(ns_status_slots, "Status table entries of a private namespace, containers beyond them lose the fast path");
 
 /**
  * Initialize and register the kernel module
@@ -76,27 +86,93 @@ struct mutex *container_lock, *switch_lock;
 
 int processor_container_init(void)
 {
-    int ret;
-    if ((ret = misc_register(&processor_container_dev)))
-        printk(KERN_ERR "Unable to register \"processor_container\" misc device\n");
-    else
-        printk(KERN_ERR "\"processor_container\" misc device installed\n");
-    
+    int ret = -ENOMEM, i;
     //my code added here
-    container_list_head = (struct list_head*) kcalloc(1, sizeof(struct list_head), GFP_KERNEL);
-    container_lock = (struct mutex*) kcalloc(1, sizeof(struct mutex), GFP_KERNEL);
-    mutex_init(container_lock);
-    INIT_LIST_HEAD(container_list_head);
+    for (i = 0; i < ARRAY_SIZE(task_table_locks); i++)
+        spin_lock_init(&task_table_locks[i]);
+    //nodes are allocated and freed on every create/delete, keep them pooled
+    container_cache = KMEM_CACHE(container_list_node, SLAB_HWCACHE_ALIGN);
+    task_cache = KMEM_CACHE(task_list_node, SLAB_HWCACHE_ALIGN);
+    if (!container_cache || !task_cache) {
+        printk(KERN_ERR "Unable to allocate container caches\n");
+        goto fail_cache;
+    }
+    //the table has to exist before the device node becomes visible
+    if ((ret = processor_container_ns_init())) {
+        printk(KERN_ERR "Unable to allocate container tables\n");
+        goto fail_cache;
+    }
+
+    processor_container_stats_init();
+    processor_container_gang_init();
+    processor_container_block_init();
+    if ((ret = processor_container_reap_init())) {
+        printk(KERN_ERR "Unable to hook task exit\n");
+        goto fail_stats;
+    }
+
+    if ((ret = misc_register(&processor_container_dev))) {
+        printk(KERN_ERR "Unable to register \"processor_container\" misc device\n");
+        goto fail_reap;
+    }
+    printk(KERN_ERR "\"processor_container\" misc device installed\n");
+    return 0;
+
+fail_reap:
+    processor_container_reap_exit();
+fail_stats:
+    processor_container_block_exit();
+    processor_container_stats_exit();
+    processor_container_ns_exit();
+fail_cache:
+    kmem_cache_destroy(task_cache);
+    kmem_cache_destroy(container_cache);
     return ret;
 }
 
 
 /**
- * Cleanup and deregister the kernel module
+ * Every open file gets its own state, see struct container_file.
+ */
+int processor_container_open(struct inode *inode, struct file *filp)
+{
+    //misc_open() leaves the miscdevice here
+    struct container_file *file = kzalloc(sizeof(struct container_file), GFP_KERNEL);
+    if (!file)
+        return -ENOMEM;
+    filp->private_data = file;
+    return 0;
+}
+
+int processor_container_release(struct inode *inode, struct file *filp)
+{
+    struct container_file *file = filp->private_data;
+    container_watch_free(file->watch);
+    container_ring_free(file->ring);
+    if (file->ns)
+        container_ns_put(file->ns);
+    kfree(file);
+    return 0;
+}
+
+/**
+ * Cleanup and deregister the kernel module. Every task node holds a module
+ * reference, so no container or node is left by now; only the RCU
+ * callbacks that freed the last ones may still be running.
  */ 
 void processor_container_exit(void)
 {
-    kfree(container_list_head);
-    kfree(container_lock);
     misc_deregister(&processor_container_dev);
+    processor_container_event_exit();
+    processor_container_reap_exit();
+    processor_container_gang_exit();
+    processor_container_block_exit();
+    processor_container_stats_exit();
+    processor_container_lock_exit();
+    //let pending container_free_rcu() and task_free_rcu() callbacks finish
+    //before the text goes away
+    rcu_barrier();
+    processor_container_ns_exit();
+    kmem_cache_destroy(task_cache);
+    kmem_cache_destroy(container_cache);
 }
@@ -0,0 +1,317 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2016
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Event notification of Processor Container
+//
+////////////////////////////////////////////////////////////////////////
+
+
+#include "processor_container.h"
+
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/poll.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/pid.h>
+#include <linux/pid_namespace.h>
+#include <linux/jiffies.h>
+#include <linux/uaccess.h>
+
+#include "processor_container_internal.h"
+
+#define WATCH_ENTRIES 256
+#define WATCH_MASK (WATCH_ENTRIES - 1)
+
+/**
+ * The event queue of an open file, created by its first
+ * PCONTAINER_IOCTL_WATCH and freed when the file is closed. Events are
+ * queued under the lock of their container, so the events of one
+ * container are always in order; when the queue is full, they are counted
+ * and reported as one PCONTAINER_EVENT_LOST once there is room again.
+ */
+struct container_watch {
+    struct list_head link;//linkage in watch_list
+    struct container_file *file;//owner, only containers of its namespace are watched
+    spinlock_t lock;//protects everything below
+    __u64 cid;//watched container, PCONTAINER_WATCH_ALL for all of them
+    __u32 mask;//1 << type of every event to queue
+    u32 head;
+    u32 tail;
+    u64 lost;//dropped since the last PCONTAINER_EVENT_LOST
+    struct pid_namespace *pid_ns;//of the watcher, tids are reported in it
+    wait_queue_head_t wait;//readers sleep here while the queue is empty
+    struct processor_container_event queue[WATCH_ENTRIES];
+};
+
+/**
+ * Every watch, read under RCU. watch_list_lock serializes changes to the
+ * list and to nr_starve_watches, and nests outside the watch locks.
+ */
+static LIST_HEAD(watch_list);
+static DEFINE_SPINLOCK(watch_list_lock);
+int nr_watches;//watches in watch_list
+static int nr_starve_watches;//watches asking for PCONTAINER_EVENT_STARVED
+
+static void container_starve_check(struct work_struct *work);
+static DECLARE_DELAYED_WORK(starve_work, container_starve_check);
+
+/**
+ * Queue an event. Must be called with watch->lock held.
+ */
+static void watch_push(struct container_watch *watch, struct processor_container_event *event)
+{
+    struct processor_container_event *lost;
+    if (watch->lost) {
+        //the LOST record and the event itself
+        if (watch->tail - watch->head > WATCH_ENTRIES - 2) {
+            watch->lost++;
+            return;
+        }
+        lost = &watch->queue[watch->tail++ & WATCH_MASK];
+        lost->cid = watch->cid;
+        lost->time_ns = event->time_ns;
+        lost->value = watch->lost;
+        lost->type = PCONTAINER_EVENT_LOST;
+        lost->tid = 0;
+        watch->lost = 0;
+    }
+    else if (watch->tail - watch->head == WATCH_ENTRIES) {
+        watch->lost = 1;
+        return;
+    }
+    watch->queue[watch->tail++ & WATCH_MASK] = *event;
+}
+
+/**
+ * Queue an event of a container on every watch that asked for it and wake
+ * up its readers. task is the member that joined or left, if any.
+ */
+void container_event_post(struct container_list_node *container, __u32 type, struct task_list_node *task, __u64 value)
+{
+    struct processor_container_event event = {
+        .cid = container->cid,
+        .time_ns = ktime_get_ns(),
+        .value = value,
+        .type = type,
+    };
+    struct container_watch *watch;
+    bool queued;
+    rcu_read_lock();
+    list_for_each_entry_rcu(watch, &watch_list, link) {
+        spin_lock(&watch->lock);
+        queued = (watch->mask & (1U << type)) && READ_ONCE(watch->file->ns) == container->ns &&
+                 (watch->cid == PCONTAINER_WATCH_ALL || watch->cid == container->cid);
+        if (queued) {
+            event.tid = task ? pid_nr_ns(task->pid, watch->pid_ns) : 0;
+            watch_push(watch, &event);
+        }
+        spin_unlock(&watch->lock);
+        if (queued)
+            wake_up_interruptible_poll(&watch->wait, POLLIN | POLLRDNORM);
+    }
+    rcu_read_unlock();
+}
+
+/**
+ * Look for containers whose members want to run but got no CPU for longer
+ * than their starvation threshold, every starve_check_us while somebody
+ * watches for it. Members that hold a slot and are not asleep outside the
+ * module, or wait for a slot, want to run; the scheduler updates the CPU
+ * time of a running task at least once a tick, which bounds the precision.
+ * A container is reported once until its members run again.
+ */
+static void container_starve_check(struct work_struct *work)
+{
+    struct container_ns *ns;
+    struct container_list_node *container;
+    struct task_list_node *task;
+    bool wants;
+    u64 exec, now;
+    rcu_read_lock();
+    list_for_each_entry_rcu(ns, &ns_list, link) {
+        list_for_each_entry_rcu(container, &ns->list, list) {
+            if (!READ_ONCE(container->starve_ns))
+                continue;
+            spin_lock(&container->lock);
+            if (container->dead || !container->starve_ns) {
+                spin_unlock(&container->lock);
+                continue;
+            }
+            exec = 0;
+            wants = !list_empty(&container->task_head);
+            list_for_each_entry(task, &container->running_head, list) {
+                exec += task->task_id->se.sum_exec_runtime;
+                wants |= !task->sleeping;
+            }
+            now = ktime_get_ns();
+            if (!wants || exec != container->starve_exec) {
+                container->starve_exec = exec;
+                container->starve_since = now;
+                container->starved = false;
+            }
+            else if (!container->starved && now - container->starve_since >= container->starve_ns) {
+                container->starved = true;
+                container_event(container, PCONTAINER_EVENT_STARVED, NULL, now - container->starve_since);
+            }
+            spin_unlock(&container->lock);
+        }
+    }
+    rcu_read_unlock();
+    spin_lock(&watch_list_lock);
+    if (nr_starve_watches)
+        schedule_delayed_work(&starve_work, usecs_to_jiffies(starve_check_us));
+    spin_unlock(&watch_list_lock);
+}
+
+static struct container_watch *watch_get(struct container_file *file)
+{
+    struct container_watch *watch = READ_ONCE(file->watch), *old;
+    if (watch)
+        return watch;
+    watch = kzalloc(sizeof(*watch), GFP_KERNEL);
+    if (!watch)
+        return NULL;
+    watch->file = file;
+    spin_lock_init(&watch->lock);
+    init_waitqueue_head(&watch->wait);
+    watch->pid_ns = get_pid_ns(task_active_pid_ns(current));
+    //two threads may start watching on the same file at once
+    old = cmpxchg(&file->watch, NULL, watch);
+    if (old) {
+        put_pid_ns(watch->pid_ns);
+        kfree(watch);
+        return old;
+    }
+    spin_lock(&watch_list_lock);
+    list_add_tail_rcu(&watch->link, &watch_list);
+    WRITE_ONCE(nr_watches, nr_watches + 1);
+    spin_unlock(&watch_list_lock);
+    return watch;
+}
+
+/**
+ * Set which container the file watches for which events. A zero mask
+ * stops queueing; events already queued can still be read.
+ */
+long processor_container_watch(struct file *filp, struct processor_container_param __user *user_param)
+{
+    struct processor_container_param param;
+    struct container_watch *watch;
+    bool starve_was, starve_now;
+    if (copy_from_user(&param, user_param, sizeof(param)))
+        return -EFAULT;
+    if (param.value >> (PCONTAINER_EVENT_LOST + 1))
+        return -EINVAL;
+    //events are matched against the namespace, it must not move any more
+    container_file_ns(filp);
+    watch = watch_get(filp->private_data);
+    if (!watch)
+        return -ENOMEM;
+    spin_lock(&watch_list_lock);
+    spin_lock(&watch->lock);
+    starve_was = watch->mask & (1U << PCONTAINER_EVENT_STARVED);
+    watch->cid = param.cid;
+    watch->mask = param.value;
+    starve_now = watch->mask & (1U << PCONTAINER_EVENT_STARVED);
+    spin_unlock(&watch->lock);
+    nr_starve_watches += (int)starve_now - (int)starve_was;
+    if (starve_now && !starve_was && nr_starve_watches == 1)
+        schedule_delayed_work(&starve_work, usecs_to_jiffies(starve_check_us));
+    spin_unlock(&watch_list_lock);
+    return 0;
+}
+
+/**
+ * Copy as many whole queued events as fit into buf, waiting for the first
+ * one unless the file is non-blocking.
+ */
+ssize_t processor_container_read(struct file *filp, char __user *buf, size_t count, loff_t *ppos)
+{
+    struct container_file *file = filp->private_data;
+    struct container_watch *watch = READ_ONCE(file->watch);
+    struct processor_container_event event;
+    ssize_t done = 0;
+    int ret;
+    if (!watch || count < sizeof(event))
+        return -EINVAL;
+    while (count - done >= sizeof(event)) {
+        spin_lock(&watch->lock);
+        if (watch->head == watch->tail) {
+            spin_unlock(&watch->lock);
+            if (done)
+                break;
+            if (filp->f_flags & O_NONBLOCK)
+                return -EAGAIN;
+            ret = wait_event_interruptible(watch->wait, READ_ONCE(watch->head) != READ_ONCE(watch->tail));
+            if (ret)
+                return ret;
+            continue;
+        }
+        event = watch->queue[watch->head++ & WATCH_MASK];
+        spin_unlock(&watch->lock);
+        if (copy_to_user(buf + done, &event, sizeof(event)))
+            return done ? done : -EFAULT;
+        done += sizeof(event);
+    }
+    return done;
+}
+
+unsigned int processor_container_poll(struct file *filp, struct poll_table_struct *wait)
+{
+    struct container_file *file = filp->private_data;
+    struct container_watch *watch = READ_ONCE(file->watch);
+    if (!watch)
+        return POLLERR;
+    poll_wait(filp, &watch->wait, wait);
+    return READ_ONCE(watch->head) != READ_ONCE(watch->tail) ? POLLIN | POLLRDNORM : 0;
+}
+
+/**
+ * Stop the watch of a file that is being closed and free it.
+ */
+void container_watch_free(struct container_watch *watch)
+{
+    if (!watch)
+        return;
+    spin_lock(&watch_list_lock);
+    list_del_rcu(&watch->link);
+    WRITE_ONCE(nr_watches, nr_watches - 1);
+    if (watch->mask & (1U << PCONTAINER_EVENT_STARVED))
+        nr_starve_watches--;
+    spin_unlock(&watch_list_lock);
+    //events may still be queued on it
+    synchronize_rcu();
+    put_pid_ns(watch->pid_ns);
+    kfree(watch);
+}
+
+void processor_container_event_exit(void)
+{
+    cancel_delayed_work_sync(&starve_work);
+}
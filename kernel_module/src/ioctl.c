@@ -44,172 +44,1823 @@
 #include <linux/mutex.h>
 #include <linux/sched.h>
 #include <linux/kthread.h>
+#include <linux/spinlock.h>
+#include <linux/rcupdate.h>
+#include <linux/hrtimer.h>
+#include <linux/signal.h>
+#include <linux/capability.h>
+#include <linux/percpu.h>
+#include <linux/ktime.h>
+#include <linux/workqueue.h>
+#include <linux/wait.h>
+#include <linux/cpumask.h>
+#include <linux/numa.h>
+#include <linux/nodemask.h>
+#include <linux/atomic.h>
+#include <linux/tracepoint.h>
 
 #include <linux/list.h>
 
-//my define of two structures
-struct task_list_node {
-    struct list_head list;
-    struct task_struct* task_id;
+#include "processor_container_internal.h"
+
+#define CREATE_TRACE_POINTS
+#include "processor_container_trace.h"
+
+/**
+ * Allocate an empty, unpublished container.
+ */
+static struct container_list_node *container_alloc(struct container_ns *ns, __u64 cid)
+{
+    struct container_list_node *container = kmem_cache_zalloc(container_cache, GFP_KERNEL);
+    if (!container)
+        return NULL;
+    container->cid = cid;
+    container->ns = ns;
+    container_ns_get(ns);
+    spin_lock_init(&container->lock);
+    INIT_LIST_HEAD(&container->running_head);
+    INIT_LIST_HEAD(&container->task_head);
+    INIT_LIST_HEAD(&container->blocked_head);
+    container->concurrency = 1;
+    container->quantum_ns = quantum_ns;
+    container->slice_ns = quantum_ns;
+    container->stats = alloc_percpu(struct container_stats);
+    if (!container->stats)
+        goto fail;
+    if (!zalloc_cpumask_var(&container->cpus, GFP_KERNEL))
+        goto fail_cpus;
+    container_status_alloc(container);
+    return container;
+
+fail_cpus:
+    free_percpu(container->stats);
+fail:
+    container_ns_put(ns);
+    kmem_cache_free(container_cache, container);
+    return NULL;
+}
+
+/**
+ * Free a container that is not reachable by anybody any more.
+ */
+static void container_free(struct container_list_node *container)
+{
+    container_status_free(container);
+    free_cpumask_var(container->cpus);
+    free_percpu(container->stats);
+    container_ns_put(container->ns);
+    kmem_cache_free(container_cache, container);
+}
+
+/**
+ * RCU callback that frees a container once no lockless reader can see it.
+ */
+static void container_free_rcu(struct rcu_head *rcu)
+{
+    container_free(container_of(rcu, struct container_list_node, rcu));
+}
+
+/**
+ * RCU callback that frees a task node once it is out of task_table. The
+ * module may go away after the last one, processor_container_exit() waits
+ * for the callback to return.
+ */
+static void task_free_rcu(struct rcu_head *rcu)
+{
+    struct task_list_node *task = container_of(rcu, struct task_list_node, rcu);
+    put_pid(task->pid);
+    put_task_struct(task->task_id);
+    kmem_cache_free(task_cache, task);
+    module_put(THIS_MODULE);
+}
+
+/**
+ * Find a live container by cid in ns and return it with its lock held, or NULL.
+ */
+struct container_list_node *container_lookup_lock(struct container_ns *ns, __u64 cid)
+{
+    struct container_list_node *container;
+    rcu_read_lock();
+    container = rhashtable_lookup_fast(&ns->table, &cid, container_table_params);
+    if (container) {
+        spin_lock(&container->lock);
+        if (container->dead) {
+            spin_unlock(&container->lock);
+            container = NULL;
+        }
+    }
+    rcu_read_unlock();
+    return container;
+}
+
+/**
+ * Find the node of a task in a container, the running ones are checked first.
+ * Must be called with container->lock held.
+ */
+static struct task_list_node *container_find_task(struct container_list_node *container, struct task_struct *task)
+{
+    struct task_list_node *node;
+    list_for_each_entry(node, &container->running_head, list)
+        if (node->task_id == task)
+            return node;
+    list_for_each_entry(node, &container->task_head, list)
+        if (node->task_id == task)
+            return node;
+    list_for_each_entry(node, &container->blocked_head, list)
+        if (node->task_id == task)
+            return node;
+    return NULL;
+}
+
+/**
+ * Quantum timer callback of a running task, runs in hard irq context. It
+ * only asks the task to yield; the rotation itself happens when the task
+ * enters processor_container_switch() from its signal handler. A node's
+ * timer is cancelled before the node is freed.
+ */
+static enum hrtimer_restart container_quantum_expired(struct hrtimer *timer)
+{
+    struct task_list_node *task = container_of(timer, struct task_list_node, timer);
+    WRITE_ONCE(task->expired, true);
+    send_sig(SIGPROF, task->task_id, 1);
+    return HRTIMER_NORESTART;
+}
+
+/**
+ * Make a task enter its switch call. The end of a slice comes with
+ * SI_KERNEL, and the signal handler skips the call for it while the status
+ * table shows that nobody waits; this one comes with SI_USER, so the
+ * handler always makes the call and learns the slot of its container.
+ */
+void container_signal_switch(struct task_struct *task)
+{
+    send_sig(SIGPROF, task, 0);
+}
+
+/**
+ * Check whether some running task should give up its slot: somebody is
+ * waiting for one, or the container runs more tasks than it may. Gang
+ * containers are only ever rotated as a whole, by gang_timer.
+ * Must be called with container->lock held.
+ */
+static bool container_oversubscribed(struct container_list_node *container)
+{
+    if (container->gang)
+        return false;
+    return !list_empty(&container->task_head) || container->nr_running > container->concurrency;
+}
+
+/**
+ * Arm the slice timer of every running task that has none pending while
+ * the container is oversubscribed, and stop them all otherwise.
+ * Must be called with container->lock held.
+ */
+static void container_update_timers(struct container_list_node *container)
+{
+    struct task_list_node *node;
+    bool arm = container->slice_ns && container_oversubscribed(container);
+    list_for_each_entry(node, &container->running_head, list) {
+        if (!arm)
+            hrtimer_try_to_cancel(&node->timer);
+        else if (!hrtimer_active(&node->timer))
+            hrtimer_start(&node->timer, ns_to_ktime(container->slice_ns), HRTIMER_MODE_REL);
+    }
+}
+
+/**
+ * In adaptive mode, double the slice of a container whose task used all of
+ * it and halve it when the task gave the slot up early, within a factor of
+ * PCONTAINER_ADAPTIVE_RANGE around the quantum. CPU-bound containers thus
+ * switch less often and ones that yield early rotate faster.
+ * Must be called with container->lock held.
+ */
+static void container_adapt_slice(struct container_list_node *container, struct task_list_node *task)
+{
+    bool expired = READ_ONCE(task->expired);
+    WRITE_ONCE(task->expired, false);
+    if (!container->adaptive || !container->quantum_ns)
+        return;
+    if (expired)
+        container->slice_ns = min(container->slice_ns * 2, container->quantum_ns * PCONTAINER_ADAPTIVE_RANGE);
+    else
+        container->slice_ns = max(container->slice_ns / 2, container->quantum_ns / PCONTAINER_ADAPTIVE_RANGE);
+}
+
+/**
+ * Give a task that is on no list yet a running slot if there is a free
+ * one, or queue it at the tail of the waiting tasks. Returns whether it
+ * got a slot. Must be called with container->lock held.
+ */
+static bool container_enqueue(struct container_list_node *container, struct task_list_node *task)
+{
+    container->nr_tasks++;
+    task->running = container->nr_running < container_slots(container);
+    if (task->running) {
+        list_add_tail(&task->list, &container->running_head);
+        container->nr_running++;
+    } else
+        list_add_tail(&task->list, &container->task_head);
+    container_update_timers(container);
+    container_status_update(container);
+    return task->running;
+}
+
+/**
+ * Wake a task that was just given a running slot. Only the wait queue of
+ * its node is woken, so a task that sleeps anywhere else, in a futex or a
+ * read, is left alone and finds its slot in its next switch call. A sync
+ * wakeup tells the scheduler that the caller is about to sleep, so it
+ * prefers the caller's CPU for the woken task.
+ * Must be called with container->lock held.
+ */
+static void task_wake(struct container_list_node *container, struct task_list_node *task, bool sync)
+{
+    this_cpu_inc(container->stats->wakeups);
+    WRITE_ONCE(task->woken_at, ktime_get_ns());
+    trace_pcontainer_wakeup(container->cid, task->task_id);
+    if (sync)
+        wake_up_interruptible_sync(&task->wait);
+    else
+        wake_up_interruptible(&task->wait);
+}
+
+/**
+ * Give the first free running slot to the task that waited longest with a
+ * sync wakeup. The caller, which is about to sleep, then hands its CPU over
+ * to it in schedule().
+ * Must be called with container->lock held.
+ */
+static void container_handoff(struct container_list_node *container)
+{
+    struct task_list_node *next;
+    if (container->nr_running >= container_slots(container) || list_empty(&container->task_head))
+        return;
+    next = list_first_entry(&container->task_head, struct task_list_node, list);
+    list_move_tail(&next->list, &container->running_head);
+    container->nr_running++;
+    next->running = true;
+    task_wake(container, next, true);
+}
+
+/**
+ * Fill the free running slots with the tasks that waited longest and wake
+ * them up. Where a woken task runs is left to the scheduler, which puts it
+ * on an idle CPU if there is one.
+ * Must be called with container->lock held.
+ */
+static void container_run_next(struct container_list_node *container)
+{
+    struct task_list_node *next;
+    while (container->nr_running < container_slots(container) && !list_empty(&container->task_head)) {
+        next = list_first_entry(&container->task_head, struct task_list_node, list);
+        list_move_tail(&next->list, &container->running_head);
+        container->nr_running++;
+        next->running = true;
+        task_wake(container, next, false);
+    }
+    container_update_timers(container);
+    container_status_update(container);
+}
+
+/**
+ * Charge the CPU time a task used since the last call to its node and its
+ * container. Must be called with container->lock held; when the task is not
+ * the caller, its runtime is only as current as its last tick.
+ */
+static void task_account(struct task_list_node *task)
+{
+    u64 exec = task->task_id->se.sum_exec_runtime;
+    u64 delta = exec - task->exec_mark;
+    task->exec_mark = exec;
+    task->runtime_ns += delta;
+    this_cpu_add(task->container->stats->runtime_ns, delta);
+}
+
+/**
+ * Record how long the caller took to run after being handed the slice.
+ * Called by the task itself on return from schedule(); a node is only ever
+ * freed by its own task, so it is still valid here.
+ */
+static void task_woken(struct task_list_node *task)
+{
+    struct container_list_node *container;
+    u64 woken_at = READ_ONCE(task->woken_at);
+    u64 latency;
+    unsigned int bucket;
+    if (!woken_at)
+        return;
+    WRITE_ONCE(task->woken_at, 0);
+    latency = ktime_get_ns() - woken_at;
+    bucket = fls64(latency / NSEC_PER_USEC);
+    if (bucket >= PCONTAINER_LATENCY_BUCKETS)
+        bucket = PCONTAINER_LATENCY_BUCKETS - 1;
+    rcu_read_lock();
+    container = READ_ONCE(task->container);
+    this_cpu_inc(container->stats->latency_hist[bucket]);
+    trace_pcontainer_switch_in(container->cid, current, latency);
+    rcu_read_unlock();
+}
+
+/**
+ * CFS load weight of nice levels -20 ... 19, see sched_prio_to_weight.
+ */
+static const int nice_to_weight[40] = {
+    88761, 71755, 56483, 46273, 36291,
+    29154, 23254, 18705, 14949, 11916,
+     9548,  7620,  6100,  4904,  3906,
+     3121,  2501,  1991,  1586,  1277,
+     1024,   820,   655,   526,   423,
+      335,   272,   215,   172,   137,
+      110,    87,    70,    56,    45,
+       36,    29,    23,    18,    15,
 };
 
-struct container_list_node {
-    struct list_head list;
-    int cid;
-    struct list_head* task_head;//should be the head of a linklist of task_list_node
-    struct list_head* running_task;//should be the executing front(within a container)
+/**
+ * Map container shares onto the nice level with the closest load weight,
+ * so 1024 shares is nice 0 like cpu.shares of a cgroup.
+ */
+static int shares_to_nice(__u64 shares)
+{
+    int nice;
+    for (nice = -20; nice < 19; nice++)
+        if (shares * 2 >= nice_to_weight[nice + 20] + nice_to_weight[nice + 21])
+            break;
+    return nice;
+}
+
+/**
+ * Give a member the nice level of its container's shares, or its own nice
+ * level back when the container is not weighted.
+ * Must be called with container->lock held.
+ */
+static void task_apply_shares(struct task_list_node *task)
+{
+    struct container_list_node *container = task->container;
+    set_user_nice(task->task_id, container->shares ? shares_to_nice(container->shares) : task->orig_nice);
+}
+
+/**
+ * Gang containers take turns as a whole: gang_active runs every member at
+ * once while the members of all other gang containers are parked, and
+ * gang_timer hands the turn on to the next container in gang_list once the
+ * quantum of gang_active is over. The rotation itself needs the container
+ * locks, so the timer leaves it to gang_work.
+ */
+static LIST_HEAD(gang_list);
+static struct container_list_node *gang_active;
+static DEFINE_SPINLOCK(gang_lock);
+static struct hrtimer gang_timer;
+static void gang_rotate(struct work_struct *work);
+static DECLARE_WORK(gang_work, gang_rotate);
+
+static enum hrtimer_restart gang_quantum_expired(struct hrtimer *timer)
+{
+    schedule_work(&gang_work);
+    return HRTIMER_NORESTART;
+}
+
+/**
+ * Start the turn of a gang container and wake all of its members.
+ * Must be called with container->lock held.
+ */
+static void container_gang_start(struct container_list_node *container)
+{
+    container->gang_on = true;
+    container_run_next(container);
+}
+
+/**
+ * End the turn of a gang container. Every running member gives up its slot
+ * and is signalled to park in its next switch call.
+ * Must be called with container->lock held.
+ */
+static void container_gang_stop(struct container_list_node *container)
+{
+    struct task_list_node *node;
+    container->gang_on = false;
+    container_status_update(container);
+    list_for_each_entry(node, &container->running_head, list) {
+        task_account(node);
+        trace_pcontainer_switch_out(container->cid, node->task_id);
+        node->running = false;
+        hrtimer_try_to_cancel(&node->timer);
+        node->park = true;
+        container_signal_switch(node->task_id);
+    }
+    list_splice_tail_init(&container->running_head, &container->task_head);
+    container->nr_running = 0;
+    this_cpu_inc(container->stats->switches);
+}
+
+/**
+ * Hand the gang turn from gang_active to the next gang container. A
+ * container picked here may leave gang mode before its lock is taken; it
+ * then takes itself out of the rotation and queues another one.
+ */
+static void gang_rotate(struct work_struct *work)
+{
+    struct container_list_node *prev, *next = NULL;
+    u64 quantum = 0;
+    bool others;
+    //containers are freed after a grace period, and leave gang_list before
+    rcu_read_lock();
+    spin_lock(&gang_lock);
+    prev = gang_active;
+    if (prev && !list_is_last(&prev->gang_link, &gang_list))
+        next = list_next_entry(prev, gang_link);
+    else
+        next = list_first_entry_or_null(&gang_list, struct container_list_node, gang_link);
+    gang_active = next;
+    others = next && !list_is_singular(&gang_list);
+    spin_unlock(&gang_lock);
+    if (prev && prev != next) {
+        spin_lock(&prev->lock);
+        if (prev->gang_on)
+            container_gang_stop(prev);
+        spin_unlock(&prev->lock);
+    }
+    if (next) {
+        spin_lock(&next->lock);
+        if (next->gang && !next->gang_on)
+            container_gang_start(next);
+        quantum = next->quantum_ns;
+        spin_unlock(&next->lock);
+    }
+    rcu_read_unlock();
+    if (others && quantum)
+        hrtimer_start(&gang_timer, ns_to_ktime(quantum), HRTIMER_MODE_REL);
+}
+
+/**
+ * Put a container into the gang rotation. It gets the turn right away if
+ * nobody has it; otherwise its running members are parked until its turn.
+ * Must be called with container->lock held.
+ */
+static void container_gang_join(struct container_list_node *container)
+{
+    struct container_list_node *active;
+    u64 quantum = 0;
+    container->gang = true;
+    spin_lock(&gang_lock);
+    list_add_tail(&container->gang_link, &gang_list);
+    active = gang_active;
+    if (!active)
+        gang_active = container;
+    else if (!hrtimer_active(&gang_timer))
+        //the active container just got somebody to hand the turn to
+        quantum = READ_ONCE(active->quantum_ns);
+    spin_unlock(&gang_lock);
+    if (!active)
+        container_gang_start(container);
+    else
+        container_gang_stop(container);
+    if (quantum)
+        hrtimer_start(&gang_timer, ns_to_ktime(quantum), HRTIMER_MODE_REL);
+}
+
+/**
+ * Take a container out of the gang rotation, passing the turn on if it had
+ * it. The caller refills or trims its running slots by its concurrency.
+ * Must be called with container->lock held.
+ */
+static void container_gang_leave(struct container_list_node *container)
+{
+    bool active;
+    spin_lock(&gang_lock);
+    list_del(&container->gang_link);
+    active = gang_active == container;
+    if (active)
+        gang_active = NULL;
+    spin_unlock(&gang_lock);
+    container->gang = false;
+    container->gang_on = false;
+    if (active)
+        schedule_work(&gang_work);
+}
+
+void processor_container_gang_init(void)
+{
+    hrtimer_init(&gang_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    gang_timer.function = gang_quantum_expired;
+}
+
+void processor_container_gang_exit(void)
+{
+    //the timer queues the work and the work restarts the timer
+    cancel_work_sync(&gang_work);
+    hrtimer_cancel(&gang_timer);
+    cancel_work_sync(&gang_work);
+}
+
+/**
+ * Lock the container a task node is in; migration may move the node until
+ * the lock is held. Must be called under rcu_read_lock().
+ */
+static struct container_list_node *task_lock_container(struct task_list_node *task)
+{
+    struct container_list_node *container;
+    for (;;) {
+        container = READ_ONCE(task->container);
+        spin_lock(&container->lock);
+        if (container == task->container)
+            return container;
+        spin_unlock(&container->lock);
+    }
+}
+
+#ifdef CONFIG_PREEMPT_NOTIFIERS
+/**
+ * A member holding a slot went to sleep outside the module, in I/O, a
+ * futex or a pipe. Give its slot to the task that waited longest, unless
+ * it woke up meanwhile or nobody waits. Runs from a work item because the
+ * scheduler hooks cannot take container locks.
+ */
+static void task_block_work(struct work_struct *work)
+{
+    struct task_list_node *task = container_of(work, struct task_list_node, block_work);
+    struct container_list_node *container;
+    rcu_read_lock();
+    //the work may start after the node left its container and the grace
+    //period of a destroyed container began; it then must not touch it
+    if (READ_ONCE(task->removed)) {
+        rcu_read_unlock();
+        return;
+    }
+    container = task_lock_container(task);
+    if (task->running && task->sleeping && !container->gang && !list_empty(&container->task_head)) {
+        task_account(task);
+        this_cpu_inc(container->stats->switches);
+        trace_pcontainer_switch_out(container->cid, task->task_id);
+        task->running = false;
+        task->blocked = true;
+        container->nr_running--;
+        hrtimer_try_to_cancel(&task->timer);
+        list_move_tail(&task->list, &container->blocked_head);
+        container_run_next(container);
+    }
+    spin_unlock(&container->lock);
+    rcu_read_unlock();
+}
+
+static void task_block_irq(struct irq_work *work)
+{
+    schedule_work(&container_of(work, struct task_list_node, block_irq)->block_work);
+}
+
+/**
+ * Preempt notifier called with the runqueue locked when the task leaves the
+ * CPU. Only a running member that blocks matters; a preempted one is still
+ * runnable and keeps its slot.
+ */
+static void task_sched_out(struct preempt_notifier *notifier, struct task_struct *next)
+{
+    struct task_list_node *task = container_of(notifier, struct task_list_node, notifier);
+    if (task_is_running(current) || !READ_ONCE(task->running) || !READ_ONCE(block_aware))
+        return;
+    WRITE_ONCE(task->sleeping, true);
+    irq_work_queue(&task->block_irq);
+}
+
+/**
+ * Preempt notifier called when the task gets the CPU again. A member that
+ * gave its slot away while it slept takes a free slot back, or queues up
+ * for one and is signalled to park in its next switch call.
+ */
+static void task_sched_in(struct preempt_notifier *notifier, int cpu)
+{
+    struct task_list_node *task = container_of(notifier, struct task_list_node, notifier);
+    struct container_list_node *container;
+    if (!READ_ONCE(task->sleeping))
+        return;
+    rcu_read_lock();
+    if (READ_ONCE(task->removed)) {
+        rcu_read_unlock();
+        return;
+    }
+    container = task_lock_container(task);
+    task->sleeping = false;
+    if (task->blocked) {
+        task->blocked = false;
+        if (container->nr_running < container_slots(container)) {
+            list_move_tail(&task->list, &container->running_head);
+            container->nr_running++;
+            task->running = true;
+            container_update_timers(container);
+        } else {
+            list_move_tail(&task->list, &container->task_head);
+            task->park = true;
+            container_signal_switch(current);
+        }
+        container_status_update(container);
+    }
+    spin_unlock(&container->lock);
+    rcu_read_unlock();
+}
+
+static struct preempt_ops task_preempt_ops = {
+    .sched_in  = task_sched_in,
+    .sched_out = task_sched_out,
 };
 
-extern struct list_head *container_list_head;
-extern struct mutex *container_lock;
-int now = 0;
+static void task_block_init(struct task_list_node *task)
+{
+    preempt_notifier_init(&task->notifier, &task_preempt_ops);
+    init_irq_work(&task->block_irq, task_block_irq);
+    INIT_WORK(&task->block_work, task_block_work);
+}
+
 /**
- * Delete the task in the container.
+ * Start watching the caller block through one of its nodes. A node that
+ * was attached by another task is watched from its first switch call on.
+ */
+static void task_watch_blocking(struct task_list_node *task)
+{
+    if (task->notifier_registered || task->task_id != current)
+        return;
+    preempt_notifier_register(&task->notifier);
+    task->notifier_registered = true;
+}
+
+/**
+ * Stop watching a node of the caller before it is freed. The node must be
+ * removed already, so pending block work finds nothing to do.
+ */
+static void task_unwatch_blocking(struct task_list_node *task)
+{
+    if (task->notifier_registered)
+        preempt_notifier_unregister(&task->notifier);
+    irq_work_sync(&task->block_irq);
+    cancel_work_sync(&task->block_work);
+}
+
+/**
+ * Stop watching the nodes of an exiting task; only the task itself can
+ * unregister its notifiers.
+ */
+static void task_exit_unwatch(struct task_list_node *task)
+{
+    if (!task->notifier_registered)
+        return;
+    preempt_notifier_unregister(&task->notifier);
+    task->notifier_registered = false;
+}
+
+void processor_container_block_init(void)
+{
+    preempt_notifier_inc();
+}
+
+void processor_container_block_exit(void)
+{
+    preempt_notifier_dec();
+}
+#else
+//without preempt notifiers a blocked member keeps its slot until its slice ends
+static void task_block_init(struct task_list_node *task)
+{
+}
+
+static void task_watch_blocking(struct task_list_node *task)
+{
+}
+
+static void task_unwatch_blocking(struct task_list_node *task)
+{
+}
+
+static void task_exit_unwatch(struct task_list_node *task)
+{
+}
+
+void processor_container_block_init(void)
+{
+}
+
+void processor_container_block_exit(void)
+{
+}
+#endif
+
+/**
+ * Placement generations are unique across containers, so a migrated node
+ * notices that its new container is placed differently. cpus_mutex keeps
+ * concurrent container_set_cpus() calls from overtaking each other.
+ */
+static atomic64_t cpus_generation = ATOMIC64_INIT(0);
+static DEFINE_MUTEX(cpus_mutex);
+
+/**
+ * Move the caller onto the CPUs of its container if they changed since it
+ * last looked. Called by the task itself, without locks held, whenever it
+ * has just been handed a slot; only its own task frees a node.
+ */
+static void task_place_self(struct task_list_node *task)
+{
+    struct container_list_node *container;
+    cpumask_var_t cpus;
+    bool placed;
+    rcu_read_lock();
+    placed = task->cpus_seq == READ_ONCE(READ_ONCE(task->container)->cpus_seq);
+    rcu_read_unlock();
+    if (placed || !alloc_cpumask_var(&cpus, GFP_KERNEL))
+        return;
+    rcu_read_lock();
+    container = task_lock_container(task);
+    cpumask_copy(cpus, container->cpus);
+    task->cpus_seq = container->cpus_seq;
+    spin_unlock(&container->lock);
+    rcu_read_unlock();
+    set_cpus_allowed_ptr(current, cpumask_empty(cpus) ? cpu_possible_mask : cpus);
+    free_cpumask_var(cpus);
+}
+
+/**
+ * Sleep until a queued node of the caller is handed a running slot or a
+ * signal arrives; migration may move the node meanwhile. Called with
+ * container->lock held; returns the node's container with its lock held.
+ */
+static struct container_list_node *task_wait_running(struct container_list_node *container,
+                                                     struct task_list_node *self)
+{
+    DEFINE_WAIT(wait);
+    for (;;) {
+        prepare_to_wait(&self->wait, &wait, TASK_INTERRUPTIBLE);
+        if (self->running || signal_pending(current))
+            break;
+        spin_unlock(&container->lock);
+        schedule();
+        rcu_read_lock();
+        container = task_lock_container(self);
+        rcu_read_unlock();
+    }
+    finish_wait(&self->wait, &wait);
+    return container;
+}
+
+/**
+ * Wait in a switch call until the caller's node gets its slot back. Called
+ * with container->lock held, which it drops. Returns the status table slot
+ * of the container, or -ERESTARTSYS if a signal came first; the node then
+ * keeps its place in line parked, so the restarted call waits on.
+ */
+static int task_wait_switch(struct container_list_node *container, struct task_list_node *self)
+{
+    int slot;
+    container = task_wait_running(container, self);
+    if (!self->running) {
+        self->park = true;
+        spin_unlock(&container->lock);
+        return -ERESTARTSYS;
+    }
+    slot = container->slot;
+    spin_unlock(&container->lock);
+    task_woken(self);
+    task_place_self(self);
+    return slot;
+}
+
+/**
+ * Take a task node off its container, freeing its running slot if it held
+ * one. Returns whether it did or whether it gave the slot away only because
+ * it blocked; the caller refills the slot with container_run_next() unless
+ * the container is now empty.
+ * Must be called with container->lock held.
+ */
+static bool container_unlink_task(struct container_list_node *container, struct task_list_node *task)
+{
+    bool was_running = task->running || task->blocked;
+    task_account(task);
+    container->nr_tasks--;
+    task->blocked = false;
+    if (task->running) {
+        container->nr_running--;
+        task->running = false;
+        hrtimer_try_to_cancel(&task->timer);
+    }
+    list_del(&task->list);
+    return was_running;
+}
+
+/**
+ * Unpublish and free a container that has no task left. Called with
+ * container->lock held, which it drops.
+ */
+static void container_destroy(struct container_list_node *container)
+{
+    //unpublish while still holding the container lock, so anyone who
+    //finds it dead can be sure it has already left the table
+    container->dead = true;
+    container_event(container, PCONTAINER_EVENT_DESTROYED, NULL, 0);
+    if (container->gang)
+        container_gang_leave(container);
+    container_status_update(container);
+    spin_lock(&container->ns->lock);
+    rhashtable_remove_fast(&container->ns->table, &container->hash, container_table_params);
+    list_del_rcu(&container->list);
+    spin_unlock(&container->ns->lock);
+    spin_unlock(&container->lock);
+    call_rcu(&container->rcu, container_free_rcu);
+}
+
+/**
+ * Take a node off its container and out of task_table, and hand its slot
+ * on, destroying the container if it was the last member. Called with
+ * container->lock held, which it drops; the caller frees the node.
+ */
+static void container_remove_task(struct container_list_node *container, struct task_list_node *task)
+{
+    container_unlink_task(container, task);
+    //set before the container may go to call_rcu(), so block work that
+    //enters its read section later sees it, see task_block_work()
+    WRITE_ONCE(task->removed, true);
+    spin_lock(task_table_lock(task->task_id));
+    hash_del_rcu(&task->hash);
+    spin_unlock(task_table_lock(task->task_id));
+    //no task left, destroy the container
+    if (!container->nr_tasks)
+        container_destroy(container);
+    else {
+        //hand the slot on if the task was holding one
+        container_run_next(container);
+        spin_unlock(&container->lock);
+    }
+}
+
+/**
+ * Exiting tasks whose nodes still have to be taken off their containers.
+ * task_exit_probe() runs in the exiting task with preemption disabled, so
+ * the nodes are reaped from a work item.
+ */
+static LLIST_HEAD(reap_list);
+static struct tracepoint *exit_tracepoint;
+
+/**
+ * Remove the nodes of tasks that exited without deleting themselves, and
+ * wake the next member of each container right away.
+ */
+static void task_reap_work(struct work_struct *work)
+{
+    struct llist_node *list = llist_del_all(&reap_list);
+    struct task_list_node *task, *next;
+    struct container_list_node *container;
+    llist_for_each_entry_safe(task, next, list, reap) {
+        rcu_read_lock();
+        container = task_lock_container(task);
+        rcu_read_unlock();
+        trace_pcontainer_delete(container->cid, task->task_id);
+        container_event(container, PCONTAINER_EVENT_LEFT, task, 0);
+        container_remove_task(container, task);
+        task_unwatch_blocking(task);
+        hrtimer_cancel(&task->timer);
+        call_rcu(&task->rcu, task_free_rcu);
+    }
+}
+
+static DECLARE_WORK(reap_work, task_reap_work);
+
+/**
+ * sched_process_exit probe. The locks of the task go to their waiters
+ * first. The task is flagged PF_EXITING already, so no node can be added
+ * for it once its task_table lock is held here, see task_table_add().
+ * Every node is one lookup in its task_table bucket.
+ */
+static void task_exit_probe(void *data, struct task_struct *task)
+{
+    struct task_list_node *node;
+    bool found = false;
+    container_task_drop_locks(task);
+    spin_lock(task_table_lock(task));
+    hash_for_each_possible(task_table, node, hash, (unsigned long)task) {
+        if (node->task_id != task)
+            continue;
+        task_exit_unwatch(node);
+        llist_add(&node->reap, &reap_list);
+        found = true;
+    }
+    spin_unlock(task_table_lock(task));
+    if (found)
+        schedule_work(&reap_work);
+}
+
+static void task_find_exit_tracepoint(struct tracepoint *tp, void *priv)
+{
+    if (!strcmp(tp->name, "sched_process_exit"))
+        exit_tracepoint = tp;
+}
+
+int processor_container_reap_init(void)
+{
+    for_each_kernel_tracepoint(task_find_exit_tracepoint, NULL);
+    if (!exit_tracepoint)
+        return -ENOENT;
+    return tracepoint_probe_register(exit_tracepoint, (void *)task_exit_probe, NULL);
+}
+
+void processor_container_reap_exit(void)
+{
+    tracepoint_probe_unregister(exit_tracepoint, (void *)task_exit_probe, NULL);
+    tracepoint_synchronize_unregister();
+    flush_work(&reap_work);
+}
+
+/**
+ * Take a node of the caller out of its container and free it, handing the
+ * slice on if it was holding it. Called with container->lock held, which
+ * it drops.
+ */
+static void task_leave(struct container_list_node *container, struct task_list_node *task)
+{
+    trace_pcontainer_delete(container->cid, current);
+    container_event(container, PCONTAINER_EVENT_LEFT, task, 0);
+    if (container->shares)
+        set_user_nice(task->task_id, task->orig_nice);
+    container_remove_task(container, task);
+    //the node is off every list, so nobody can restart its timer
+    task_unwatch_blocking(task);
+    hrtimer_cancel(&task->timer);
+    //leaving a placed container lets the caller run anywhere again
+    if (task->cpus_seq)
+        set_cpus_allowed_ptr(current, cpu_possible_mask);
+    call_rcu(&task->rcu, task_free_rcu);
+}
+
+/**
+ * Delete the calling task from the container.
  * 
  * external functions needed:
- * mutex_lock(), mutex_unlock(), wake_up_process(), 
+ * spin_lock(), spin_unlock(), rcu_read_lock(), rcu_read_unlock(), wake_up_process()
  */
-int processor_container_delete(struct processor_container_cmd __user *user_cmd)
+int container_delete(struct container_ns *ns, __u64 cid)
 {
-    //defunc the running one in working container, then deal with others.
+    //defunc the caller, and hand the slice on if it was holding it.
     struct container_list_node *target_container;
     struct task_list_node *target_task;
-    struct list_head *container_ptr;
-    mutex_lock(container_lock);
-    printk("Delete Triggered. id:%d\n", current->pid);
-    for (container_ptr = container_list_head->next; container_ptr != container_list_head; container_ptr = container_ptr->next) {
-        target_container = list_entry(container_ptr, struct container_list_node, list);
-        if (target_container->cid == user_cmd->cid) break;
-    }
-    target_task = list_entry(target_container->running_task, struct task_list_node, list);
-    target_container->running_task = target_container->running_task->next;
-    list_del(target_container->running_task->prev);kfree(target_task);
-    //skip meaningless head pointer
-    if (target_container->running_task == target_container->task_head)
-        target_container->running_task = target_container->running_task->next;
-    //no task left, destroy the container
-    if (target_container->running_task == target_container->task_head) {
-        list_del(&target_container->list);kfree(target_container);
+    target_container = container_lookup_lock(ns, cid);
+    if (!target_container)
+        return -EINVAL;
+    target_task = container_find_task(target_container, current);
+    if (!target_task) {
+        spin_unlock(&target_container->lock);
+        return -EINVAL;
     }
-    //activate the next task - if there is one
-    else {
-        target_task = list_entry(target_container->running_task, struct task_list_node, list);
-        printk("Trying to wake:%d now:%d\n",target_task->task_id->pid, --now);
-        mutex_unlock(container_lock);
-        wake_up_process(target_task->task_id);
-        return 0;
+    task_leave(target_container, target_task);
+    return 0;
+}
+
+int processor_container_delete(struct container_ns *ns, struct processor_container_cmd __user *user_cmd)
+{
+    struct processor_container_cmd cmd;
+    if (copy_from_user(&cmd, user_cmd, sizeof(cmd)))
+        return -EFAULT;
+    return container_delete(ns, cmd.cid);
+}
+
+/**
+ * Allocate the node of a task that is about to join a container. A node
+ * outlives the file it was created through, and its timer, notifier and
+ * work items point into the module, so every node pins the module.
+ */
+static struct task_list_node *task_alloc(struct task_struct *task)
+{
+    struct task_list_node *node = kmem_cache_zalloc(task_cache, GFP_KERNEL);
+    if (!node)
+        return NULL;
+    //the caller's file holds a reference already
+    __module_get(THIS_MODULE);
+    //the node outlives the task if it exits without deleting itself
+    get_task_struct(task);
+    node->task_id = task;
+    node->pid = get_task_pid(task, PIDTYPE_PID);
+    node->orig_nice = task_nice(task);
+    node->exec_mark = task->se.sum_exec_runtime;
+    hrtimer_init(&node->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    node->timer.function = container_quantum_expired;
+    init_waitqueue_head(&node->wait);
+    task_block_init(node);
+    return node;
+}
+
+/**
+ * Free a node that never made it into a container.
+ */
+static void task_free(struct task_list_node *node)
+{
+    put_pid(node->pid);
+    put_task_struct(node->task_id);
+    kmem_cache_free(task_cache, node);
+    module_put(THIS_MODULE);
+}
+
+/**
+ * Add a node to task_table, unless its task is exiting and
+ * task_exit_probe() may have looked for its nodes already.
+ */
+static bool task_table_add(struct task_list_node *node)
+{
+    bool ok;
+    spin_lock(task_table_lock(node->task_id));
+    ok = !(node->task_id->flags & PF_EXITING);
+    if (ok)
+        hash_add_rcu(task_table, &node->hash, (unsigned long)node->task_id);
+    spin_unlock(task_table_lock(node->task_id));
+    return ok;
+}
+
+/**
+ * Check whether a task already has a node in a container.
+ * Must be called with container->lock held.
+ */
+static bool container_has_task(struct container_list_node *container, struct task_struct *task)
+{
+    struct task_list_node *node;
+    bool found = false;
+    rcu_read_lock();
+    hash_for_each_possible_rcu(task_table, node, hash, (unsigned long)task)
+        if (node->task_id == task && node->container == container) {
+            found = true;
+            break;
+        }
+    rcu_read_unlock();
+    return found;
+}
+
+/**
+ * Queue a task node in container cid, creating the container if there is
+ * none. The node gets a running slot if the container has a free one.
+ * Returns the container with its lock held, or an ERR_PTR; the node is the
+ * caller's to free on error.
+ */
+static struct container_list_node *container_join(struct container_ns *ns, __u64 cid, struct task_list_node *new_task)
+{
+    struct container_list_node *target_container, *new_container = NULL;
+    struct task_struct *task = new_task->task_id;
+    int ret;
+retry:
+    rcu_read_lock();
+    target_container = rhashtable_lookup_fast(&ns->table, &cid, container_table_params);
+    if (target_container) {
+        spin_lock(&target_container->lock);
+        rcu_read_unlock();
+        if (!target_container->dead) {
+            if (new_container)
+                container_free(new_container);
+            if (container_has_task(target_container, task)) {
+                spin_unlock(&target_container->lock);
+                return ERR_PTR(-EEXIST);
+            }
+            //insert into found container
+            new_task->container = target_container;
+            if (!task_table_add(new_task)) {
+                spin_unlock(&target_container->lock);
+                return ERR_PTR(-ESRCH);
+            }
+            container_enqueue(target_container, new_task);
+            if (target_container->shares)
+                task_apply_shares(new_task);
+            return target_container;
+        }
+        //the last member just left and the container is already out of the table
+        spin_unlock(&target_container->lock);
     }
-    //else printk("No waking.\n");
+    else
+        rcu_read_unlock();
 
-    //printk("Delete done.");
-    mutex_unlock(container_lock);
-    return 0;
+    //no existing cid found, so create a new container and a new task
+    if (!new_container && !(new_container = container_alloc(ns, cid)))
+        return ERR_PTR(-ENOMEM);
+    //nobody else can see it yet, so taking its lock first keeps the lock order
+    spin_lock(&new_container->lock);
+    spin_lock(&ns->lock);
+    //somebody else may have created it since our lookup, join theirs instead
+    if (rhashtable_lookup_fast(&ns->table, &cid, container_table_params)) {
+        spin_unlock(&ns->lock);
+        spin_unlock(&new_container->lock);
+        goto retry;
+    }
+    new_task->container = new_container;
+    container_enqueue(new_container, new_task);
+    if ((ret = rhashtable_insert_fast(&ns->table, &new_container->hash, container_table_params))) {
+        spin_unlock(&ns->lock);
+        spin_unlock(&new_container->lock);
+        container_free(new_container);
+        return ERR_PTR(ret);
+    }
+    list_add_tail_rcu(&new_container->list, &ns->list);
+    spin_unlock(&ns->lock);
+    //only a node in task_table can be reaped, so add it once nothing fails
+    if (!task_table_add(new_task)) {
+        container_unlink_task(new_container, new_task);
+        container_destroy(new_container);
+        return ERR_PTR(-ESRCH);
+    }
+    container_event(new_container, PCONTAINER_EVENT_CREATED, NULL, 0);
+    return new_container;
 }
 
 /**
- * Create a task in the corresponding container.
+ * Create a task in the corresponding container. Returns the status table
+ * slot of the container the task is in once it runs, see
+ * processor_container_mmap().
  * external functions needed:
- * copy_from_user(), mutex_lock(), mutex_unlock(), set_current_state(), schedule()
+ * copy_from_user(), spin_lock(), spin_unlock(), set_current_state(), schedule()
  * 
  * external variables needed:
  * struct task_struct* current  
  */
-int processor_container_create(struct processor_container_cmd __user *user_cmd)
+int container_create(struct container_ns *ns, __u64 cid)
 {
     //find exist containers first, compare cid
-    struct list_head *container_ptr;
     struct container_list_node *target_container;
     struct task_list_node* new_task;
-    set_current_state(TASK_INTERRUPTIBLE);
-    printk("Create triggered. Container:%lld\n", user_cmd->cid);
-    mutex_lock(container_lock);
-    for (container_ptr = container_list_head->next; container_ptr != container_list_head; container_ptr = container_ptr->next) {
-        target_container = list_entry(container_ptr, struct container_list_node, list);
-        if (target_container->cid == user_cmd->cid) {
-            //insert into found container
-            new_task = (struct task_list_node *) kcalloc(1, sizeof(struct task_list_node), GFP_KERNEL);
-            //I tried to use copy_from_user() here, later find it's a waste - simple '=' will do
-            new_task->task_id = current;
-            //copy_from_user(&new_task->task_id, &current, sizeof(struct *task_struct)); - previous code
-            list_add_tail(&new_task->list, target_container->task_head);
-            //sleep current process
-            printk("task created. id:%d, now:%d\n", new_task->task_id->pid, ++now);
-            mutex_unlock(container_lock);
-            schedule();
-            return 0;
+    int slot;
+    //allocate up front, nothing below may sleep until we queue ourselves
+    new_task = task_alloc(current);
+    if (!new_task)
+        return -ENOMEM;
+    target_container = container_join(ns, cid, new_task);
+    if (IS_ERR(target_container)) {
+        task_free(new_task);
+        return PTR_ERR(target_container);
+    }
+    trace_pcontainer_create(cid, current);
+    container_event(target_container, PCONTAINER_EVENT_JOINED, new_task, 0);
+    task_watch_blocking(new_task);
+    if (new_task->running) {
+        slot = target_container->slot;
+        spin_unlock(&target_container->lock);
+        task_place_self(new_task);
+        return slot;
+    }
+    //sleep current process
+    target_container = task_wait_running(target_container, new_task);
+    if (!new_task->running) {
+        //a signal came first: leave again, so a restarted call queues anew
+        task_leave(target_container, new_task);
+        return -ERESTARTSYS;
+    }
+    slot = target_container->slot;
+    spin_unlock(&target_container->lock);
+    task_woken(new_task);
+    task_place_self(new_task);
+    return slot;
+}
+
+int processor_container_create(struct container_ns *ns, struct processor_container_cmd __user *user_cmd)
+{
+    struct processor_container_cmd cmd;
+    if (copy_from_user(&cmd, user_cmd, sizeof(cmd)))
+        return -EFAULT;
+    return container_create(ns, cmd.cid);
+}
+
+/**
+ * Look up the task of a thread id in the caller's pid namespace. Tasks of
+ * other processes need CAP_SYS_NICE. Returns it with a reference held.
+ */
+static struct task_struct *task_get_by_tid(pid_t tid)
+{
+    struct task_struct *task;
+    rcu_read_lock();
+    task = get_pid_task(find_vpid(tid), PIDTYPE_PID);
+    rcu_read_unlock();
+    if (!task)
+        return ERR_PTR(-ESRCH);
+    if (!same_thread_group(task, current) && !capable(CAP_SYS_NICE)) {
+        put_task_struct(task);
+        return ERR_PTR(-EPERM);
+    }
+    return task;
+}
+
+/**
+ * Put another task into container cid. The task is signalled so that its
+ * handler picks up the status slot of the container; unless it ends up
+ * holding the slice, it parks itself in that switch call until its turn
+ * comes.
+ */
+int container_attach(struct container_ns *ns, __u64 cid, pid_t tid)
+{
+    struct container_list_node *target_container;
+    struct task_list_node *new_task;
+    struct task_struct *task;
+    int ret = 0;
+    task = task_get_by_tid(tid);
+    if (IS_ERR(task))
+        return PTR_ERR(task);
+    new_task = task_alloc(task);
+    if (!new_task) {
+        ret = -ENOMEM;
+        goto out;
+    }
+    target_container = container_join(ns, cid, new_task);
+    if (IS_ERR(target_container)) {
+        task_free(new_task);
+        ret = PTR_ERR(target_container);
+        goto out;
+    }
+    trace_pcontainer_create(cid, task);
+    container_event(target_container, PCONTAINER_EVENT_JOINED, new_task, 0);
+    if (!new_task->running)
+        new_task->park = true;
+    container_signal_switch(task);
+    spin_unlock(&target_container->lock);
+out:
+    put_task_struct(task);
+    return ret;
+}
+
+/**
+ * Attach every thread of the process of tgid to container cid; any thread
+ * id of the process will do. Threads that are
+ * already members or exit meanwhile are skipped. Returns the number of
+ * threads attached.
+ */
+int container_attach_group(struct container_ns *ns, __u64 cid, pid_t tgid)
+{
+    struct task_struct *leader, *thread;
+    pid_t *tids;
+    int nr, count = 0, attached = 0, i, ret;
+    rcu_read_lock();
+    leader = pid_task(find_vpid(tgid), PIDTYPE_PID);
+    nr = leader ? get_nr_threads(leader) : 0;
+    rcu_read_unlock();
+    if (!nr)
+        return -ESRCH;
+    //leave some room for threads created before the second walk
+    nr += 16;
+    tids = kmalloc_array(nr, sizeof(pid_t), GFP_KERNEL);
+    if (!tids)
+        return -ENOMEM;
+    rcu_read_lock();
+    leader = pid_task(find_vpid(tgid), PIDTYPE_PID);
+    if (leader)
+        for_each_thread(leader, thread) {
+            if (count == nr)
+                break;
+            tids[count++] = task_pid_vnr(thread);
+        }
+    rcu_read_unlock();
+    for (i = 0; i < count; i++) {
+        ret = container_attach(ns, cid, tids[i]);
+        if (!ret)
+            attached++;
+        else if (ret != -ESRCH && ret != -EEXIST) {
+            attached = attached ? attached : ret;
+            break;
         }
     }
-    //no existing cid found, so create a new container and a new task
-    target_container = (struct container_list_node *) kcalloc(1, sizeof(struct container_list_node), GFP_KERNEL);
-    target_container->cid = user_cmd->cid;
-    target_container->task_head = (struct list_head *) kcalloc(1, sizeof(struct list_head), GFP_KERNEL);
-    INIT_LIST_HEAD(target_container->task_head);
-    new_task = (struct task_list_node *) kcalloc(1, sizeof(struct task_list_node), GFP_KERNEL);
-    new_task->task_id = current;
-    //copy_from_user(&new_task->task_id, &current, sizeof(struct *task_struct));
-    list_add_tail(&new_task->list, target_container->task_head);
-    target_container->running_task = &new_task->list;
-    list_add_tail(&target_container->list, container_list_head);
-    printk("Container & task created. id:%d, now:%d\n", new_task->task_id->pid, ++now);
-    set_current_state(TASK_RUNNING);
-    mutex_unlock(container_lock);
-    return 0;
+    kfree(tids);
+    return attached;
 }
 
 /**
- * switch to the next task within the container
+ * Lock two containers, b may be NULL. Migration is the only path holding
+ * two container locks, and it takes them in address order.
+ */
+static void container_lock_pair(struct container_list_node *a, struct container_list_node *b)
+{
+    if (!b) {
+        spin_lock(&a->lock);
+        return;
+    }
+    if (a > b)
+        swap(a, b);
+    spin_lock(&a->lock);
+    spin_lock_nested(&b->lock, SINGLE_DEPTH_NESTING);
+}
+
+static void container_unlock_pair(struct container_list_node *a, struct container_list_node *b)
+{
+    if (b)
+        spin_unlock(&b->lock);
+    spin_unlock(&a->lock);
+}
+
+/**
+ * Move a task from container from to container to, creating the latter if
+ * needed. The task node itself moves, so the task is in exactly one of the
+ * two at any time and finds its node where it left it when it wakes up.
+ * A task that was running in from is signalled, so that its handler picks
+ * up the status slot of to, and parks if it has to wait there; one that
+ * was waiting and gets a running slot in to is woken, and its switch or
+ * create call returns the new slot.
+ */
+int container_migrate(struct container_ns *ns, __u64 from, __u64 to, pid_t tid)
+{
+    struct container_list_node *src, *dst, *new_container = NULL;
+    struct task_list_node *node;
+    struct task_struct *task;
+    bool was_running;
+    int ret = 0;
+    if (from == to)
+        return -EINVAL;
+    task = task_get_by_tid(tid);
+    if (IS_ERR(task))
+        return PTR_ERR(task);
+retry:
+    rcu_read_lock();
+    src = rhashtable_lookup_fast(&ns->table, &from, container_table_params);
+    dst = rhashtable_lookup_fast(&ns->table, &to, container_table_params);
+    if (!src) {
+        rcu_read_unlock();
+        ret = -EINVAL;
+        goto out;
+    }
+    container_lock_pair(src, dst);
+    rcu_read_unlock();
+    if (dst && dst->dead) {
+        //it is out of the table already, the next lookup will not find it
+        container_unlock_pair(src, dst);
+        goto retry;
+    }
+    if (src->dead || !(node = container_find_task(src, task))) {
+        ret = -EINVAL;
+        goto unlock;
+    }
+    if (dst && container_has_task(dst, task)) {
+        ret = -EEXIST;
+        goto unlock;
+    }
+    if (!dst) {
+        if (!new_container) {
+            spin_unlock(&src->lock);
+            if (!(new_container = container_alloc(ns, to))) {
+                ret = -ENOMEM;
+                goto out;
+            }
+            goto retry;
+        }
+        //publish it locked, nobody can join before the task is in
+        spin_lock_nested(&new_container->lock, SINGLE_DEPTH_NESTING);
+        spin_lock(&ns->lock);
+        if (rhashtable_lookup_fast(&ns->table, &to, container_table_params)) {
+            spin_unlock(&ns->lock);
+            spin_unlock(&new_container->lock);
+            spin_unlock(&src->lock);
+            goto retry;
+        }
+        if ((ret = rhashtable_insert_fast(&ns->table, &new_container->hash, container_table_params))) {
+            spin_unlock(&ns->lock);
+            spin_unlock(&new_container->lock);
+            goto unlock;
+        }
+        list_add_tail_rcu(&new_container->list, &ns->list);
+        spin_unlock(&ns->lock);
+        dst = new_container;
+        container_event(dst, PCONTAINER_EVENT_CREATED, NULL, 0);
+        new_container = NULL;
+    }
+
+    trace_pcontainer_delete(from, task);
+    container_event(src, PCONTAINER_EVENT_LEFT, node, 0);
+    was_running = container_unlink_task(src, node);
+    WRITE_ONCE(node->container, dst);
+    if (container_enqueue(dst, node)) {
+        if (!was_running)
+            task_wake(dst, node, false);
+    } else if (was_running)
+        node->park = true;
+    if (was_running)
+        container_signal_switch(task);
+    if (dst->shares)
+        task_apply_shares(node);
+    else if (src->shares)
+        set_user_nice(task, node->orig_nice);
+    trace_pcontainer_create(to, task);
+    container_event(dst, PCONTAINER_EVENT_JOINED, node, 0);
+    if (!src->nr_tasks)
+        container_destroy(src);
+    else {
+        container_run_next(src);
+        spin_unlock(&src->lock);
+    }
+    spin_unlock(&dst->lock);
+    goto out;
+unlock:
+    container_unlock_pair(src, dst);
+out:
+    if (new_container)
+        container_free(new_container);
+    put_task_struct(task);
+    return ret;
+}
+
+int processor_container_attach(struct container_ns *ns, struct processor_container_param __user *user_param)
+{
+    struct processor_container_param param;
+    if (copy_from_user(&param, user_param, sizeof(param)))
+        return -EFAULT;
+    return container_attach(ns, param.cid, (pid_t)param.value);
+}
+
+int processor_container_attach_group(struct container_ns *ns, struct processor_container_param __user *user_param)
+{
+    struct processor_container_param param;
+    if (copy_from_user(&param, user_param, sizeof(param)))
+        return -EFAULT;
+    return container_attach_group(ns, param.cid, (pid_t)param.value);
+}
+
+int processor_container_migrate(struct container_ns *ns, struct processor_container_migrate __user *user_migrate)
+{
+    struct processor_container_migrate migrate;
+    if (copy_from_user(&migrate, user_migrate, sizeof(migrate)))
+        return -EFAULT;
+    return container_migrate(ns, migrate.from, migrate.to, migrate.tid);
+}
+
+/**
+ * give the caller's running slot to the task of its container that waited
+ * longest. Nothing happens while nobody waits and the container is within
+ * its concurrency. A caller holding a kernel lock keeps the slot; the
+ * switch is replayed when it releases the lock. A caller that was attached
+ * from outside and has no slot goes to sleep until its turn instead.
+ * Returns the status table slot of the caller's container, see
+ * processor_container_mmap(), or PCONTAINER_NO_SLOT if it is in none.
  * 
  * external functions needed:
- * mutex_lock(), mutex_unlock(), wake_up_process(), set_current_state(), schedule()
+ * spin_lock(), spin_unlock(), wake_up_process(), set_current_state(), schedule()
  */
-int processor_container_switch(struct processor_container_cmd __user *user_cmd)
+int container_switch_current(void)
 {   
-    //return 0;
-    //move the running task of working_container and move working_container itself.
-    struct list_head *container_ptr;
-    struct container_list_node *target_container;
-    struct task_list_node *target_task;
-    set_current_state(TASK_INTERRUPTIBLE);
-    printk("Switch triggered.trigger id:%d\n", current->pid);
-    mutex_lock(container_lock);
-    for (container_ptr = container_list_head->next; container_ptr != container_list_head; container_ptr = container_ptr->next) {
-        target_container = list_entry(container_ptr, struct container_list_node, list);
-        target_task = list_entry(target_container->running_task, struct task_list_node, list);
-        if (target_task->task_id->pid == current->pid) break;
-    }
-    if (target_task->task_id->pid == current->pid) {
-        target_container->running_task = target_container->running_task->next;
-        if (target_container->running_task == target_container->task_head)
-            target_container->running_task = target_container->running_task->next;
-        target_task = list_entry(target_container->running_task, struct task_list_node, list);
-        wake_up_process(target_task->task_id);
-        //printk("Switch done. Past:%d, Now:%d\n",current->pid, target_task->task_id->pid);
-        mutex_unlock(container_lock);
-        schedule();
+    struct container_list_node *target_container = NULL;
+    struct task_list_node *target_task, *self;
+    int slot;
+    //the caller's node is the one in its bucket that is running in its container;
+    //once that container's lock is held the node cannot go away
+    rcu_read_lock();
+    hash_for_each_possible_rcu(task_table, target_task, hash, (unsigned long)current) {
+        if (target_task->task_id != current)
+            continue;
+        target_container = target_task->container;
+        spin_lock(&target_container->lock);
+        if (target_task->running || target_task->park)
+            break;
+        spin_unlock(&target_container->lock);
     }
-    else {
-        set_current_state(TASK_RUNNING);
-        mutex_unlock(container_lock);
+    rcu_read_unlock();
+    if (!target_task)
+        return PCONTAINER_NO_SLOT;
+    self = target_task;
+    task_watch_blocking(self);
+    //the container may be gone as soon as its lock is dropped
+    slot = target_container->slot;
+    if (self->park && !self->running) {
+        //a parked lock holder sleeps once it released its last lock
+        if (container_task_defer_switch()) {
+            spin_unlock(&target_container->lock);
+            return slot;
+        }
+        self->park = false;
+        return task_wait_switch(target_container, self);
+    }
+    if (self->park) {
+        //it was handed the slot before it came to park, or while a signal
+        //interrupted its wait; it has waited its turn already
+        self->park = false;
+        spin_unlock(&target_container->lock);
+        task_place_self(self);
+        return slot;
+    }
+    if (!container_oversubscribed(target_container)) {
+        WRITE_ONCE(self->expired, false);
+        spin_unlock(&target_container->lock);
+        return slot;
+    }
+    if (container_task_defer_switch()) {
+        spin_unlock(&target_container->lock);
+        return slot;
     }
-    //printk("Switch done.\n");
+    task_account(self);
+    container_adapt_slice(target_container, self);
+    this_cpu_inc(target_container->stats->switches);
+    trace_pcontainer_switch_out(target_container->cid, current);
+    //go to the back of the line, and let the head take the slot
+    self->running = false;
+    target_container->nr_running--;
+    hrtimer_try_to_cancel(&self->timer);
+    list_move_tail(&self->list, &target_container->task_head);
+    if (READ_ONCE(handoff))
+        container_handoff(target_container);
+    container_run_next(target_container);
+    return task_wait_switch(target_container, self);
+}
+
+/**
+ * switch to the next task within the container
+ */
+int processor_container_switch(struct processor_container_cmd __user *user_cmd)
+{
+    return container_switch_current();
+}
+
+/**
+ * Set the time slice of a container in nanoseconds. Zero turns the kernel
+ * timer off, so only explicit switch calls rotate the container.
+ */
+int container_set_quantum(struct container_ns *ns, __u64 cid, __u64 value)
+{
+    struct container_list_node *target_container;
+    struct task_list_node *node;
+    target_container = container_lookup_lock(ns, cid);
+    if (!target_container)
+        return -EINVAL;
+    target_container->quantum_ns = value;
+    target_container->slice_ns = value;
+    //restart the current slices with the new length
+    list_for_each_entry(node, &target_container->running_head, list)
+        hrtimer_try_to_cancel(&node->timer);
+    container_update_timers(target_container);
+    spin_unlock(&target_container->lock);
     return 0;
 }
 
+int processor_container_set_quantum(struct container_ns *ns, struct processor_container_param __user *user_param)
+{
+    struct processor_container_param param;
+    if (copy_from_user(&param, user_param, sizeof(param)))
+        return -EFAULT;
+    return container_set_quantum(ns, param.cid, param.value);
+}
+
+/**
+ * Turn the adaptive slice of a container on or off. The slice starts out at
+ * the quantum either way, and adapts from there while the mode is on.
+ */
+int container_set_adaptive(struct container_ns *ns, __u64 cid, __u64 value)
+{
+    struct container_list_node *target_container;
+    target_container = container_lookup_lock(ns, cid);
+    if (!target_container)
+        return -EINVAL;
+    target_container->adaptive = value;
+    target_container->slice_ns = target_container->quantum_ns;
+    spin_unlock(&target_container->lock);
+    return 0;
+}
+
+int processor_container_set_adaptive(struct container_ns *ns, struct processor_container_param __user *user_param)
+{
+    struct processor_container_param param;
+    if (copy_from_user(&param, user_param, sizeof(param)))
+        return -EFAULT;
+    return container_set_adaptive(ns, param.cid, param.value);
+}
+
+/**
+ * Report the container to the files watching for PCONTAINER_EVENT_STARVED
+ * once its members got no CPU for value ns, see container_starve_check().
+ * Zero turns it off.
+ */
+int container_set_starve(struct container_ns *ns, __u64 cid, __u64 value)
+{
+    struct container_list_node *target_container;
+    target_container = container_lookup_lock(ns, cid);
+    if (!target_container)
+        return -EINVAL;
+    target_container->starve_ns = value;
+    target_container->starve_since = ktime_get_ns();
+    target_container->starved = false;
+    spin_unlock(&target_container->lock);
+    return 0;
+}
+
+int processor_container_set_starve(struct container_ns *ns, struct processor_container_param __user *user_param)
+{
+    struct processor_container_param param;
+    if (copy_from_user(&param, user_param, sizeof(param)))
+        return -EFAULT;
+    return container_set_starve(ns, param.cid, param.value);
+}
+
+/**
+ * Set the CPU shares of a container. Every member runs at the nice level
+ * whose CFS weight matches the shares, and since a container of concurrency
+ * 1 only has one task running at a time, CFS then splits the CPU between
+ * such containers in proportion to their shares. Zero returns the members
+ * to their own nice.
+ */
+int container_set_shares(struct container_ns *ns, __u64 cid, __u64 value)
+{
+    struct container_list_node *target_container;
+    struct list_head *task_ptr;
+    //more than the default weight is a priority boost
+    if (value && shares_to_nice(value) < 0 && !capable(CAP_SYS_NICE))
+        return -EPERM;
+    target_container = container_lookup_lock(ns, cid);
+    if (!target_container)
+        return -EINVAL;
+    target_container->shares = value;
+    list_for_each(task_ptr, &target_container->running_head)
+        task_apply_shares(list_entry(task_ptr, struct task_list_node, list));
+    list_for_each(task_ptr, &target_container->task_head)
+        task_apply_shares(list_entry(task_ptr, struct task_list_node, list));
+    list_for_each(task_ptr, &target_container->blocked_head)
+        task_apply_shares(list_entry(task_ptr, struct task_list_node, list));
+    spin_unlock(&target_container->lock);
+    return 0;
+}
+
+int processor_container_set_shares(struct container_ns *ns, struct processor_container_param __user *user_param)
+{
+    struct processor_container_param param;
+    if (copy_from_user(&param, user_param, sizeof(param)))
+        return -EFAULT;
+    return container_set_shares(ns, param.cid, param.value);
+}
+
+/**
+ * Set how many tasks of a container may run at the same time. Raising it
+ * wakes waiting tasks right away; after lowering it, the surplus running
+ * tasks are rotated out at the end of their slices.
+ */
+int container_set_concurrency(struct container_ns *ns, __u64 cid, __u64 value)
+{
+    struct container_list_node *target_container;
+    if (!value || value > INT_MAX)
+        return -EINVAL;
+    target_container = container_lookup_lock(ns, cid);
+    if (!target_container)
+        return -EINVAL;
+    target_container->concurrency = value;
+    container_run_next(target_container);
+    spin_unlock(&target_container->lock);
+    return 0;
+}
+
+int processor_container_set_concurrency(struct container_ns *ns, struct processor_container_param __user *user_param)
+{
+    struct processor_container_param param;
+    if (copy_from_user(&param, user_param, sizeof(param)))
+        return -EFAULT;
+    return container_set_concurrency(ns, param.cid, param.value);
+}
+
+/**
+ * Turn gang mode of a container on or off. A gang container runs all of
+ * its members at the same time, regardless of its concurrency, and takes
+ * turns with the other gang containers for the length of its quantum; a
+ * quantum of 0 keeps the turn until the container leaves gang mode.
+ */
+int container_set_gang(struct container_ns *ns, __u64 cid, __u64 value)
+{
+    struct container_list_node *target_container;
+    target_container = container_lookup_lock(ns, cid);
+    if (!target_container)
+        return -EINVAL;
+    if (value && !target_container->gang)
+        container_gang_join(target_container);
+    else if (!value && target_container->gang) {
+        container_gang_leave(target_container);
+        container_run_next(target_container);
+    }
+    spin_unlock(&target_container->lock);
+    return 0;
+}
+
+int processor_container_set_gang(struct container_ns *ns, struct processor_container_param __user *user_param)
+{
+    struct processor_container_param param;
+    if (copy_from_user(&param, user_param, sizeof(param)))
+        return -EFAULT;
+    return container_set_gang(ns, param.cid, param.value);
+}
+
+/**
+ * Restrict the members of a container to a set of CPUs, or let them run
+ * anywhere again if it is empty. Current members are moved right away and
+ * tasks joining later move themselves when they are first handed a slot.
+ * Within the set, the scheduler keeps a woken member on an idle CPU close
+ * to the one it or the previous member ran on, so a set within one LLC or
+ * NUMA node keeps the container's caches warm across switches.
+ */
+int container_set_cpus(struct container_ns *ns, __u64 cid, const struct cpumask *cpus)
+{
+    struct container_list_node *target_container;
+    struct task_list_node *node;
+    struct task_struct **tasks = NULL;
+    int nr = 0, i = 0, ret = 0;
+    mutex_lock(&cpus_mutex);
+    for (;;) {
+        target_container = container_lookup_lock(ns, cid);
+        if (!target_container) {
+            ret = -EINVAL;
+            goto out;
+        }
+        if (target_container->nr_tasks <= nr)
+            break;
+        //make room for every member, outside the container lock
+        nr = target_container->nr_tasks;
+        spin_unlock(&target_container->lock);
+        kfree(tasks);
+        tasks = kmalloc_array(nr, sizeof(*tasks), GFP_KERNEL);
+        if (!tasks) {
+            ret = -ENOMEM;
+            goto out;
+        }
+    }
+    cpumask_copy(target_container->cpus, cpus);
+    target_container->cpus_seq = atomic64_inc_return(&cpus_generation);
+    list_for_each_entry(node, &target_container->running_head, list)
+        tasks[i++] = node->task_id;
+    list_for_each_entry(node, &target_container->task_head, list)
+        tasks[i++] = node->task_id;
+    list_for_each_entry(node, &target_container->blocked_head, list)
+        tasks[i++] = node->task_id;
+    nr = i;
+    for (i = 0; i < nr; i++)
+        get_task_struct(tasks[i]);
+    spin_unlock(&target_container->lock);
+    for (i = 0; i < nr; i++) {
+        set_cpus_allowed_ptr(tasks[i], cpumask_empty(cpus) ? cpu_possible_mask : cpus);
+        put_task_struct(tasks[i]);
+    }
+out:
+    mutex_unlock(&cpus_mutex);
+    kfree(tasks);
+    return ret;
+}
+
+int processor_container_set_cpus(struct container_ns *ns, struct processor_container_cpus __user *user_cpus)
+{
+    struct processor_container_cpus param;
+    cpumask_var_t cpus;
+    int cpu, ret;
+    if (copy_from_user(&param, user_cpus, sizeof(param)))
+        return -EFAULT;
+    if (!zalloc_cpumask_var(&cpus, GFP_KERNEL))
+        return -ENOMEM;
+    for (cpu = 0; cpu < PCONTAINER_MAX_CPUS && cpu < nr_cpu_ids; cpu++)
+        if (param.mask[cpu / 64] & (1ULL << (cpu % 64)))
+            cpumask_set_cpu(cpu, cpus);
+    ret = -EINVAL;
+    if (param.node != NUMA_NO_NODE) {
+        if (param.node < 0 || param.node >= nr_node_ids || !node_online(param.node))
+            goto out;
+        //a node alone stands for all of its CPUs
+        if (cpumask_empty(cpus))
+            cpumask_copy(cpus, cpumask_of_node(param.node));
+        else
+            cpumask_and(cpus, cpus, cpumask_of_node(param.node));
+        if (cpumask_empty(cpus))
+            goto out;
+    }
+    if (!cpumask_empty(cpus) && !cpumask_intersects(cpus, cpu_online_mask))
+        goto out;
+    ret = container_set_cpus(ns, param.cid, cpus);
+out:
+    free_cpumask_var(cpus);
+    return ret;
+}
+
 /**
  * control function that receive the command in user space and pass arguments to
  * corresponding functions.
  */
-int processor_container_ioctl(struct file *filp, unsigned int cmd,
-                              unsigned long arg)
+long processor_container_ioctl(struct file *filp, unsigned int cmd,
+                               unsigned long arg)
 {
+    //only the commands that use a namespace settle it, see PCONTAINER_IOCTL_NEW_NS
     switch (cmd)
     {
     case PCONTAINER_IOCTL_CSWITCH:
         return processor_container_switch((void __user *)arg);
     case PCONTAINER_IOCTL_CREATE:
-        return processor_container_create((void __user *)arg);
+        return processor_container_create(container_file_ns(filp), (void __user *)arg);
     case PCONTAINER_IOCTL_DELETE:
-        return processor_container_delete((void __user *)arg);
+        return processor_container_delete(container_file_ns(filp), (void __user *)arg);
+    case PCONTAINER_IOCTL_SET_QUANTUM:
+        return processor_container_set_quantum(container_file_ns(filp), (void __user *)arg);
+    case PCONTAINER_IOCTL_SET_SHARES:
+        return processor_container_set_shares(container_file_ns(filp), (void __user *)arg);
+    case PCONTAINER_IOCTL_STATS:
+        return processor_container_stats(container_file_ns(filp), (void __user *)arg);
+    case PCONTAINER_IOCTL_LOCK:
+        return processor_container_lock(container_file_ns(filp), (void __user *)arg);
+    case PCONTAINER_IOCTL_UNLOCK:
+        return processor_container_unlock(container_file_ns(filp), (void __user *)arg);
+    case PCONTAINER_IOCTL_SUBMIT:
+        return processor_container_submit(filp);
+    case PCONTAINER_IOCTL_ATTACH:
+        return processor_container_attach(container_file_ns(filp), (void __user *)arg);
+    case PCONTAINER_IOCTL_ATTACH_GROUP:
+        return processor_container_attach_group(container_file_ns(filp), (void __user *)arg);
+    case PCONTAINER_IOCTL_MIGRATE:
+        return processor_container_migrate(container_file_ns(filp), (void __user *)arg);
+    case PCONTAINER_IOCTL_SET_CONCURRENCY:
+        return processor_container_set_concurrency(container_file_ns(filp), (void __user *)arg);
+    case PCONTAINER_IOCTL_SET_GANG:
+        return processor_container_set_gang(container_file_ns(filp), (void __user *)arg);
+    case PCONTAINER_IOCTL_SET_ADAPTIVE:
+        return processor_container_set_adaptive(container_file_ns(filp), (void __user *)arg);
+    case PCONTAINER_IOCTL_SET_CPUS:
+        return processor_container_set_cpus(container_file_ns(filp), (void __user *)arg);
+    case PCONTAINER_IOCTL_WATCH:
+        return processor_container_watch(filp, (void __user *)arg);
+    case PCONTAINER_IOCTL_SET_STARVE:
+        return processor_container_set_starve(container_file_ns(filp), (void __user *)arg);
+    case PCONTAINER_IOCTL_NEW_NS:
+        return processor_container_new_ns(filp);
     default:
         return -ENOTTY;
     }
@@ -0,0 +1,395 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2016
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Container-aware locks of Processor Container
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "processor_container.h"
+
+#include <asm/uaccess.h>
+#include <linux/slab.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/sched.h>
+#include <linux/spinlock.h>
+#include <linux/rhashtable.h>
+
+#include <linux/list.h>
+
+#include "processor_container_internal.h"
+
+/**
+ * A lock object, named by the cid field of the command within the
+ * namespace of the file. Waiters queue up in FIFO order and unlock hands
+ * ownership straight to the first one, so a lock can neither be stolen nor
+ * starve anybody. Lock objects are created on first use and freed as soon
+ * as nobody owns or waits for them; the owner is pinned until it releases
+ * the lock or exits, and the namespace until the lock is freed.
+ */
+struct pcontainer_lock {
+    struct rhash_head hash;//linkage in the locks table of ns
+    __u64 id;
+    struct container_ns *ns;//reference held
+    spinlock_t lock;//protects everything below
+    bool dead;//idle, already out of lock_table
+    struct task_struct* owner;//reference held
+    struct list_head owned;//linkage in the lock_holder of owner
+    struct list_head waiters;//lock_waiter, oldest first
+    struct rcu_head rcu;
+};
+
+struct lock_waiter {
+    struct list_head list;
+    struct task_struct* task;
+    bool granted;//set by the unlocker once task owns the lock
+};
+
+/**
+ * The locks a task owns, created by its first lock call and freed when it
+ * exits. Only the task itself touches its holder, so the hold count
+ * follows the task across containers and cannot go below zero.
+ */
+struct lock_holder {
+    struct hlist_node hash;//linkage in holder_table, keyed by task
+    struct task_struct* task;
+    struct list_head locks;//pcontainer_lock objects it owns
+    bool yield_pending;//a switch came in while it owned locks
+    struct rcu_head rcu;
+};
+
+static const struct rhashtable_params lock_table_params = {
+    .key_len     = sizeof(__u64),
+    .key_offset  = offsetof(struct pcontainer_lock, id),
+    .head_offset = offsetof(struct pcontainer_lock, hash),
+};
+
+//inserts and removals take the task_table lock of the bucket
+static DEFINE_HASHTABLE(holder_table, TASK_TABLE_BITS);
+
+static struct lock_holder *holder_find(struct task_struct *task)
+{
+    struct lock_holder *holder;
+    hash_for_each_possible_rcu(holder_table, holder, hash, (unsigned long)task)
+        if (holder->task == task)
+            return holder;
+    return NULL;
+}
+
+/**
+ * Find the holder of the caller, creating it on first use.
+ */
+static struct lock_holder *holder_get(void)
+{
+    struct lock_holder *holder;
+    rcu_read_lock();
+    holder = holder_find(current);
+    rcu_read_unlock();
+    if (holder)
+        return holder;
+    holder = kzalloc(sizeof(*holder), GFP_KERNEL);
+    if (!holder)
+        return NULL;
+    holder->task = current;
+    INIT_LIST_HEAD(&holder->locks);
+    spin_lock(task_table_lock(current));
+    hash_add_rcu(holder_table, &holder->hash, (unsigned long)current);
+    spin_unlock(task_table_lock(current));
+    return holder;
+}
+
+/**
+ * Find the lock object with the given id in ns and return it with its lock
+ * held, creating it on first use.
+ */
+static struct pcontainer_lock *lock_get_lock(struct container_ns *ns, __u64 id)
+{
+    struct pcontainer_lock *lock, *new_lock = NULL;
+    int ret;
+retry:
+    rcu_read_lock();
+    lock = rhashtable_lookup_fast(&ns->locks, &id, lock_table_params);
+    if (lock) {
+        spin_lock(&lock->lock);
+        rcu_read_unlock();
+        if (!lock->dead) {
+            if (new_lock) {
+                container_ns_put(ns);
+                kfree(new_lock);
+            }
+            return lock;
+        }
+        //it is out of the table already, the next lookup will not find it
+        spin_unlock(&lock->lock);
+        goto retry;
+    }
+    rcu_read_unlock();
+    if (!new_lock) {
+        new_lock = kzalloc(sizeof(*new_lock), GFP_KERNEL);
+        if (!new_lock)
+            return ERR_PTR(-ENOMEM);
+        new_lock->id = id;
+        new_lock->ns = ns;
+        container_ns_get(ns);
+        spin_lock_init(&new_lock->lock);
+        INIT_LIST_HEAD(&new_lock->owned);
+        INIT_LIST_HEAD(&new_lock->waiters);
+        goto retry;
+    }
+    spin_lock(&new_lock->lock);
+    ret = rhashtable_lookup_insert_fast(&ns->locks, &new_lock->hash, lock_table_params);
+    if (ret) {
+        spin_unlock(&new_lock->lock);
+        //somebody else created it first
+        if (ret == -EEXIST)
+            goto retry;
+        container_ns_put(ns);
+        kfree(new_lock);
+        return ERR_PTR(ret);
+    }
+    return new_lock;
+}
+
+/**
+ * Hand a lock to the oldest waiter, or free it if nobody waits. The owner
+ * already took it off its holder. Called with lock->lock held, which it
+ * drops; never sleeps, so the exit path can use it.
+ */
+static void lock_release(struct pcontainer_lock *lock)
+{
+    struct task_struct *prev = lock->owner, *next = NULL;
+    struct container_ns *ns = lock->ns;
+    struct lock_waiter *waiter;
+    if (list_empty(&lock->waiters)) {
+        lock->owner = NULL;
+        lock->dead = true;
+        rhashtable_remove_fast(&ns->locks, &lock->hash, lock_table_params);
+    } else {
+        waiter = list_first_entry(&lock->waiters, struct lock_waiter, list);
+        list_del(&waiter->list);
+        next = waiter->task;
+        //one reference for the lock, one for the wakeup below; the waiter
+        //may return as soon as it sees granted
+        get_task_struct(next);
+        get_task_struct(next);
+        lock->owner = next;
+        smp_store_release(&waiter->granted, true);
+    }
+    spin_unlock(&lock->lock);
+    if (next) {
+        wake_up_process(next);
+        put_task_struct(next);
+    } else {
+        kfree_rcu(lock, rcu);
+        container_ns_put(ns);
+    }
+    put_task_struct(prev);
+}
+
+/**
+ * Acquire the lock, sleeping in FIFO order behind the current waiters.
+ * While it is held the caller is not rotated out of its container.
+ *
+ * external functions needed:
+ * spin_lock(), spin_unlock(), set_current_state(), schedule()
+ */
+long processor_container_lock(struct container_ns *ns, struct processor_container_cmd __user *user_cmd)
+{
+    struct processor_container_cmd cmd;
+    struct pcontainer_lock *lock;
+    struct lock_holder *holder;
+    struct lock_waiter waiter;
+    if (copy_from_user(&cmd, user_cmd, sizeof(cmd)))
+        return -EFAULT;
+    holder = holder_get();
+    if (!holder)
+        return -ENOMEM;
+    lock = lock_get_lock(ns, cmd.cid);
+    if (IS_ERR(lock))
+        return PTR_ERR(lock);
+    if (!lock->owner) {
+        get_task_struct(current);
+        lock->owner = current;
+        list_add(&lock->owned, &holder->locks);
+        spin_unlock(&lock->lock);
+        return 0;
+    }
+    if (lock->owner == current) {
+        spin_unlock(&lock->lock);
+        return -EDEADLK;
+    }
+    waiter.task = current;
+    waiter.granted = false;
+    list_add_tail(&waiter.list, &lock->waiters);
+    for (;;) {
+        //the preemption signal must not cut the wait short, only a kill may
+        set_current_state(TASK_KILLABLE);
+        spin_unlock(&lock->lock);
+        schedule();
+        if (smp_load_acquire(&waiter.granted))
+            break;
+        spin_lock(&lock->lock);
+        if (waiter.granted) {
+            spin_unlock(&lock->lock);
+            break;
+        }
+        if (fatal_signal_pending(current)) {
+            //the lock has an owner, so it stays alive without us
+            list_del(&waiter.list);
+            spin_unlock(&lock->lock);
+            return -EINTR;
+        }
+    }
+    __set_current_state(TASK_RUNNING);
+    //the unlocker made us the owner, only we may touch our holder
+    spin_lock(&lock->lock);
+    list_add(&lock->owned, &holder->locks);
+    spin_unlock(&lock->lock);
+    return 0;
+}
+
+/**
+ * Release the lock and hand it to the oldest waiter, if there is one. A
+ * switch that was held back while the caller owned locks runs once the
+ * last one is released.
+ *
+ * external functions needed:
+ * spin_lock(), spin_unlock(), wake_up_process()
+ */
+long processor_container_unlock(struct container_ns *ns, struct processor_container_cmd __user *user_cmd)
+{
+    struct processor_container_cmd cmd;
+    struct pcontainer_lock *lock;
+    struct lock_holder *holder;
+    bool yield = false;
+    if (copy_from_user(&cmd, user_cmd, sizeof(cmd)))
+        return -EFAULT;
+    rcu_read_lock();
+    lock = rhashtable_lookup_fast(&ns->locks, &cmd.cid, lock_table_params);
+    if (!lock) {
+        rcu_read_unlock();
+        return -EINVAL;
+    }
+    spin_lock(&lock->lock);
+    rcu_read_unlock();
+    if (lock->owner != current) {
+        spin_unlock(&lock->lock);
+        return -EPERM;
+    }
+    list_del_init(&lock->owned);
+    lock_release(lock);
+    //an owner always has a holder
+    rcu_read_lock();
+    holder = holder_find(current);
+    if (list_empty(&holder->locks) && holder->yield_pending) {
+        holder->yield_pending = false;
+        yield = true;
+    }
+    rcu_read_unlock();
+    //a wait cut short by a signal is taken up again by the handler
+    if (yield && container_switch_current() == -ERESTARTSYS)
+        container_signal_switch(current);
+    return 0;
+}
+
+/**
+ * Check whether the caller owns a lock, and if so remember that a switch
+ * has to run once it released the last one. Called from the switch path.
+ */
+bool container_task_defer_switch(void)
+{
+    struct lock_holder *holder;
+    bool defer;
+    rcu_read_lock();
+    holder = holder_find(current);
+    defer = holder && !list_empty(&holder->locks);
+    if (defer)
+        holder->yield_pending = true;
+    rcu_read_unlock();
+    return defer;
+}
+
+/**
+ * Hand the locks of an exiting task to their oldest waiters and free its
+ * holder. Called by the task itself from its exit probe, which may not
+ * sleep.
+ */
+void container_task_drop_locks(struct task_struct *task)
+{
+    struct lock_holder *holder;
+    struct pcontainer_lock *lock, *tmp;
+    rcu_read_lock();
+    holder = holder_find(task);
+    rcu_read_unlock();
+    if (!holder)
+        return;
+    list_for_each_entry_safe(lock, tmp, &holder->locks, owned) {
+        spin_lock(&lock->lock);
+        list_del_init(&lock->owned);
+        lock_release(lock);
+    }
+    spin_lock(task_table_lock(task));
+    hash_del_rcu(&holder->hash);
+    spin_unlock(task_table_lock(task));
+    kfree_rcu(holder, rcu);
+}
+
+int container_ns_locks_init(struct container_ns *ns)
+{
+    return rhashtable_init(&ns->locks, &lock_table_params);
+}
+
+/**
+ * Called once the last reference to ns is gone; every lock of it held one.
+ */
+void container_ns_locks_destroy(struct container_ns *ns)
+{
+    rhashtable_destroy(&ns->locks);
+}
+
+/**
+ * Called once the exit probe is gone and every file is closed, so nobody
+ * waits and every lock left is on the holder of its owner; owners that are
+ * still alive just lose their locks.
+ */
+void processor_container_lock_exit(void)
+{
+    struct lock_holder *holder;
+    struct pcontainer_lock *lock, *next;
+    struct hlist_node *tmp;
+    int bkt;
+    hash_for_each_safe(holder_table, bkt, tmp, holder, hash) {
+        list_for_each_entry_safe(lock, next, &holder->locks, owned) {
+            rhashtable_remove_fast(&lock->ns->locks, &lock->hash, lock_table_params);
+            put_task_struct(lock->owner);
+            container_ns_put(lock->ns);
+            kfree(lock);
+        }
+        hash_del(&holder->hash);
+        kfree(holder);
+    }
+}
@@ -0,0 +1,154 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2016
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Container namespaces of Processor Container
+//
+////////////////////////////////////////////////////////////////////////
+
+
+#include "processor_container.h"
+
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/slab.h>
+#include <linux/atomic.h>
+
+#include "processor_container_internal.h"
+
+struct container_ns init_container_ns;
+LIST_HEAD(ns_list);//every namespace, read under RCU
+static DEFINE_SPINLOCK(ns_list_lock);
+static atomic_t ns_ids = ATOMIC_INIT(0);
+
+/**
+ * Namespaces whose last reference is gone. The last container can be freed
+ * from an RCU callback, while taking a namespace apart may sleep, so that
+ * happens in a work item.
+ */
+static LLIST_HEAD(ns_free_list);
+
+static void container_ns_free_work(struct work_struct *work)
+{
+    struct llist_node *list = llist_del_all(&ns_free_list);
+    struct container_ns *ns, *next;
+    llist_for_each_entry_safe(ns, next, list, free) {
+        spin_lock(&ns_list_lock);
+        list_del_rcu(&ns->link);
+        spin_unlock(&ns_list_lock);
+        rhashtable_destroy(&ns->table);
+        container_ns_locks_destroy(ns);
+        container_ns_status_destroy(ns);
+        //the debugfs and starvation walks may still be looking at it
+        kfree_rcu(ns, rcu);
+    }
+}
+
+static DECLARE_WORK(ns_free_work, container_ns_free_work);
+
+static void container_ns_release(struct kref *ref)
+{
+    struct container_ns *ns = container_of(ref, struct container_ns, ref);
+    llist_add(&ns->free, &ns_free_list);
+    schedule_work(&ns_free_work);
+}
+
+void container_ns_put(struct container_ns *ns)
+{
+    if (ns != &init_container_ns)
+        kref_put(&ns->ref, container_ns_release);
+}
+
+static int container_ns_init(struct container_ns *ns, u32 id, unsigned int slots)
+{
+    int ret = rhashtable_init(&ns->table, &container_table_params);
+    if (ret)
+        return ret;
+    if ((ret = container_ns_locks_init(ns)))
+        goto fail_locks;
+    if ((ret = container_ns_status_init(ns, slots)))
+        goto fail_status;
+    INIT_LIST_HEAD(&ns->list);
+    spin_lock_init(&ns->lock);
+    kref_init(&ns->ref);
+    ns->id = id;
+    spin_lock(&ns_list_lock);
+    list_add_tail_rcu(&ns->link, &ns_list);
+    spin_unlock(&ns_list_lock);
+    return 0;
+
+fail_status:
+    container_ns_status_destroy(ns);
+    container_ns_locks_destroy(ns);
+fail_locks:
+    rhashtable_destroy(&ns->table);
+    return ret;
+}
+
+/**
+ * Move a file into a new, empty namespace. Only a file that has not used a
+ * namespace yet can move, see container_file_ns(), so whatever a file
+ * created, attached or watched stays reachable through it. Returns the
+ * number of entries in the status table of the namespace.
+ */
+long processor_container_new_ns(struct file *filp)
+{
+    struct container_file *file = filp->private_data;
+    struct container_ns *ns;
+    int ret;
+    if (READ_ONCE(file->ns))
+        return -EBUSY;
+    ns = kzalloc(sizeof(*ns), GFP_KERNEL);
+    if (!ns)
+        return -ENOMEM;
+    if ((ret = container_ns_init(ns, atomic_inc_return(&ns_ids), READ_ONCE(ns_status_slots)))) {
+        kfree(ns);
+        return ret;
+    }
+    //another thread may have used the file or moved it meanwhile
+    if (cmpxchg(&file->ns, NULL, ns)) {
+        container_ns_put(ns);
+        return -EBUSY;
+    }
+    return ns->status_slots;
+}
+
+int processor_container_ns_init(void)
+{
+    return container_ns_init(&init_container_ns, 0, PCONTAINER_STATUS_SLOTS);
+}
+
+void processor_container_ns_exit(void)
+{
+    //the last container_free_rcu() callbacks may have released namespaces
+    flush_work(&ns_free_work);
+    rcu_barrier();
+    list_del(&init_container_ns.link);
+    rhashtable_destroy(&init_container_ns.table);
+    container_ns_locks_destroy(&init_container_ns);
+    container_ns_status_destroy(&init_container_ns);
+}
@@ -0,0 +1,188 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2016
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Batched command ring of Processor Container
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "processor_container.h"
+
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/mutex.h>
+#include <linux/vmalloc.h>
+
+#include "processor_container_internal.h"
+
+/**
+ * The ring of an open file, created by its first mmap at
+ * PCONTAINER_RING_OFFSET and freed when the file is closed. The kernel
+ * keeps its own copies of the indexes it owns, so whatever user space
+ * writes into the shared page can only affect which commands are run.
+ */
+struct container_ring {
+    struct mutex lock;//serializes threads submitting on the same file
+    u32 sq_head;
+    u32 cq_tail;
+    u32 inflight;//taken from the SQ, completion not posted yet
+    struct processor_container_ring *shared;
+};
+
+#define RING_SIZE PAGE_ALIGN(sizeof(struct processor_container_ring))
+#define RING_MASK (PCONTAINER_RING_ENTRIES - 1)
+
+static struct container_ring *ring_get(struct container_file *file)
+{
+    struct container_ring *ring = READ_ONCE(file->ring), *old;
+    if (ring)
+        return ring;
+    ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+    if (!ring)
+        return NULL;
+    mutex_init(&ring->lock);
+    ring->shared = vmalloc_user(RING_SIZE);
+    if (!ring->shared) {
+        kfree(ring);
+        return NULL;
+    }
+    //two threads may map the ring of the same file at once
+    old = cmpxchg(&file->ring, NULL, ring);
+    if (old) {
+        vfree(ring->shared);
+        kfree(ring);
+        return old;
+    }
+    return ring;
+}
+
+int processor_container_ring_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+    struct container_ring *ring;
+    unsigned long pgoff = vma->vm_pgoff - (PCONTAINER_RING_OFFSET >> PAGE_SHIFT);
+    if (vma->vm_end - vma->vm_start + (pgoff << PAGE_SHIFT) > RING_SIZE)
+        return -EINVAL;
+    ring = ring_get(filp->private_data);
+    if (!ring)
+        return -ENOMEM;
+    return remap_vmalloc_range(vma, ring->shared, pgoff);
+}
+
+/**
+ * Run one command in ns, returning what the matching ioctl would have.
+ */
+static long ring_run(struct container_ns *ns, struct processor_container_sqe *sqe)
+{
+    long res;
+    switch (sqe->op)
+    {
+    case PCONTAINER_OP_CREATE:
+        res = container_create(ns, sqe->cid);
+        //a completion is not restarted, the caller queues the create again
+        return res == -ERESTARTSYS ? -EINTR : res;
+    case PCONTAINER_OP_DELETE:
+        return container_delete(ns, sqe->cid);
+    case PCONTAINER_OP_SET_QUANTUM:
+        return container_set_quantum(ns, sqe->cid, sqe->value);
+    case PCONTAINER_OP_SET_SHARES:
+        return container_set_shares(ns, sqe->cid, sqe->value);
+    case PCONTAINER_OP_SET_CONCURRENCY:
+        return container_set_concurrency(ns, sqe->cid, sqe->value);
+    case PCONTAINER_OP_SET_GANG:
+        return container_set_gang(ns, sqe->cid, sqe->value);
+    case PCONTAINER_OP_SET_ADAPTIVE:
+        return container_set_adaptive(ns, sqe->cid, sqe->value);
+    case PCONTAINER_OP_SET_STARVE:
+        return container_set_starve(ns, sqe->cid, sqe->value);
+    case PCONTAINER_OP_ATTACH:
+        return container_attach(ns, sqe->cid, (pid_t)sqe->value);
+    case PCONTAINER_OP_ATTACH_GROUP:
+        return container_attach_group(ns, sqe->cid, (pid_t)sqe->value);
+    case PCONTAINER_OP_MIGRATE:
+        return container_migrate(ns, sqe->cid, sqe->to, (pid_t)sqe->value);
+    default:
+        return -EINVAL;
+    }
+}
+
+/**
+ * Run the queued commands in order and post their completions. Commands
+ * are not run while the CQ has no room for their completion, so the number
+ * returned can be short of what was queued; the rest is left in the SQ.
+ * A create that has to wait for the slice sleeps here like the ioctl does,
+ * without holding up other threads submitting on the same file.
+ */
+long processor_container_submit(struct file *filp)
+{
+    struct container_file *file = filp->private_data;
+    struct container_ring *ring = READ_ONCE(file->ring);
+    struct processor_container_sqe sqe;
+    struct processor_container_cqe *cqe;
+    long done = 0, res;
+    if (!ring)
+        return -EINVAL;
+    mutex_lock(&ring->lock);
+    while (ring->sq_head != smp_load_acquire(&ring->shared->sq_tail)) {
+        if (ring->cq_tail + ring->inflight - READ_ONCE(ring->shared->cq_head) >= PCONTAINER_RING_ENTRIES) {
+            if (!done)
+                done = -EBUSY;
+            break;
+        }
+        memcpy(&sqe, &ring->shared->sq[ring->sq_head & RING_MASK], sizeof(sqe));
+        ring->sq_head++;
+        WRITE_ONCE(ring->shared->sq_head, ring->sq_head);
+        ring->inflight++;
+        mutex_unlock(&ring->lock);
+        res = ring_run(container_file_ns(filp), &sqe);
+        mutex_lock(&ring->lock);
+        ring->inflight--;
+        cqe = &ring->shared->cq[ring->cq_tail & RING_MASK];
+        cqe->user_data = sqe.user_data;
+        cqe->res = res;
+        smp_store_release(&ring->shared->cq_tail, ++ring->cq_tail);
+        done++;
+        if (fatal_signal_pending(current))
+            break;
+    }
+    mutex_unlock(&ring->lock);
+    return done;
+}
+
+/**
+ * Free the ring of a file that is being closed. The mappings hold the
+ * file, so none of them is left by now.
+ */
+void container_ring_free(struct container_ring *ring)
+{
+    if (!ring)
+        return;
+    vfree(ring->shared);
+    kfree(ring);
+}
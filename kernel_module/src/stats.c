@@ -0,0 +1,172 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2016
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Runtime statistics of Processor Container
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "processor_container.h"
+
+#include <asm/uaccess.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#include <linux/list.h>
+
+#include "processor_container_internal.h"
+
+static struct dentry *stats_dir;
+
+/**
+ * Sum up the per-CPU counters of a container.
+ * Must be called with container->lock held.
+ */
+static void container_stats_read(struct container_list_node *container,
+                                 struct processor_container_stats *stats)
+{
+    struct container_stats *pcpu;
+    int cpu, i;
+    memset(stats, 0, sizeof(*stats));
+    stats->cid = container->cid;
+    stats->nr_tasks = container->nr_tasks;
+    stats->slice_ns = container->slice_ns;
+    for_each_possible_cpu(cpu) {
+        pcpu = per_cpu_ptr(container->stats, cpu);
+        stats->switches += pcpu->switches;
+        stats->wakeups += pcpu->wakeups;
+        stats->runtime_ns += pcpu->runtime_ns;
+        for (i = 0; i < PCONTAINER_LATENCY_BUCKETS; i++)
+            stats->latency_hist[i] += pcpu->latency_hist[i];
+    }
+}
+
+/**
+ * Copy the statistics of the container named by user_stats->cid back to
+ * user space.
+ */
+int processor_container_stats(struct container_ns *ns, struct processor_container_stats __user *user_stats)
+{
+    struct processor_container_stats stats;
+    struct container_list_node *container;
+    __u64 cid;
+    if (get_user(cid, &user_stats->cid))
+        return -EFAULT;
+    container = container_lookup_lock(ns, cid);
+    if (!container)
+        return -EINVAL;
+    container_stats_read(container, &stats);
+    spin_unlock(&container->lock);
+    if (copy_to_user(user_stats, &stats, sizeof(stats)))
+        return -EFAULT;
+    return 0;
+}
+
+/**
+ * debugfs "containers": one block per live container of every namespace
+ * with its counters, the wakeup latency histogram and the runtime of every
+ * member.
+ */
+static int containers_show(struct seq_file *m, void *v)
+{
+    struct processor_container_stats stats;
+    struct container_ns *ns;
+    struct container_list_node *container;
+    struct task_list_node *task;
+    int i;
+    rcu_read_lock();
+    list_for_each_entry_rcu(ns, &ns_list, link) {
+        list_for_each_entry_rcu(container, &ns->list, list) {
+            spin_lock(&container->lock);
+            if (container->dead) {
+                spin_unlock(&container->lock);
+                continue;
+            }
+            container_stats_read(container, &stats);
+            seq_printf(m, "container %llu", stats.cid);
+            if (ns->id)
+                seq_printf(m, " ns %u", ns->id);
+            seq_printf(m, ": tasks %llu running %d/%d switches %llu wakeups %llu runtime_ns %llu slice_ns %llu%s\n",
+                       stats.nr_tasks, container->nr_running, container->concurrency,
+                       stats.switches, stats.wakeups, stats.runtime_ns, stats.slice_ns,
+                       container->adaptive ? " adaptive" : "");
+            if (!cpumask_empty(container->cpus))
+                seq_printf(m, "  cpus: %*pbl\n", cpumask_pr_args(container->cpus));
+            seq_puts(m, "  latency_us:");
+            for (i = 0; i < PCONTAINER_LATENCY_BUCKETS - 1; i++)
+                seq_printf(m, " <%d:%llu", 1 << i, stats.latency_hist[i]);
+            seq_printf(m, " >=%d:%llu\n", 1 << (i - 1), stats.latency_hist[i]);
+            list_for_each_entry(task, &container->running_head, list)
+                seq_printf(m, "  task %d: running runtime_ns %llu\n", task_pid_nr(task->task_id), task->runtime_ns);
+            list_for_each_entry(task, &container->task_head, list)
+                seq_printf(m, "  task %d: waiting runtime_ns %llu\n", task_pid_nr(task->task_id), task->runtime_ns);
+            list_for_each_entry(task, &container->blocked_head, list)
+                seq_printf(m, "  task %d: blocked runtime_ns %llu\n", task_pid_nr(task->task_id), task->runtime_ns);
+            spin_unlock(&container->lock);
+        }
+    }
+    rcu_read_unlock();
+    return 0;
+}
+
+static int containers_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, containers_show, NULL);
+}
+
+static const struct file_operations containers_fops = {
+    .owner   = THIS_MODULE,
+    .open    = containers_open,
+    .read    = seq_read,
+    .llseek  = seq_lseek,
+    .release = single_release,
+};
+
+/**
+ * Create /sys/kernel/debug/pcontainer. A kernel without debugfs only loses
+ * the file, the stats ioctl keeps working.
+ */
+int processor_container_stats_init(void)
+{
+    stats_dir = debugfs_create_dir("pcontainer", NULL);
+    if (IS_ERR_OR_NULL(stats_dir)) {
+        stats_dir = NULL;
+        return 0;
+    }
+    debugfs_create_file("containers", 0444, stats_dir, NULL, &containers_fops);
+    return 0;
+}
+
+void processor_container_stats_exit(void)
+{
+    debugfs_remove_recursive(stats_dir);
+}
@@ -0,0 +1,139 @@
+//////////////////////////////////////////////////////////////////////
+//                      North Carolina State University
+//
+//
+//
+//                             Copyright 2016
+//
+////////////////////////////////////////////////////////////////////////
+//
+// This program is free software; you can redistribute it and/or modify it
+// under the terms and conditions of the GNU General Public License,
+// version 2, as published by the Free Software Foundation.
+//
+// This program is distributed in the hope it will be useful, but WITHOUT
+// ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+// FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+// more details.
+//
+// You should have received a copy of the GNU General Public License along with
+// this program; if not, write to the Free Software Foundation, Inc.,
+// 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
+//
+////////////////////////////////////////////////////////////////////////
+//
+//   Author:  Hung-Wei Tseng, Yu-Chia Liu
+//
+//   Description:
+//     Shared status table of Processor Container
+//
+////////////////////////////////////////////////////////////////////////
+
+#include "processor_container.h"
+
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/vmalloc.h>
+#include <linux/idr.h>
+
+#include "processor_container_internal.h"
+
+/**
+ * Every container owns one entry of the status table of its namespace,
+ * which the files of that namespace map read-only. The library reads the
+ * entry of its own container in the signal handler and skips the switch
+ * ioctl when there is nobody to switch to. Entries are written under the
+ * container lock and read without any, so a reader may see a stale value
+ * for one tick at most. The table is mapped in whole pages.
+ */
+static unsigned long status_table_size(struct container_ns *ns)
+{
+    return PAGE_ALIGN(ns->status_slots * sizeof(struct processor_container_status));
+}
+
+/**
+ * Give a namespace a status table of slots entries, at most
+ * PCONTAINER_STATUS_SLOTS.
+ */
+int container_ns_status_init(struct container_ns *ns, unsigned int slots)
+{
+    ns->status_slots = clamp_t(unsigned int, slots, 1, PCONTAINER_STATUS_SLOTS);
+    ida_init(&ns->status_ida);
+    ns->status = vmalloc_user(status_table_size(ns));
+    return ns->status ? 0 : -ENOMEM;
+}
+
+/**
+ * Called once the last reference to ns is gone; its mappings held its
+ * files, so none is left.
+ */
+void container_ns_status_destroy(struct container_ns *ns)
+{
+    ida_destroy(&ns->status_ida);
+    vfree(ns->status);
+}
+
+/**
+ * Give a new container a status entry. Running out of entries only costs
+ * the container its fast path.
+ */
+void container_status_alloc(struct container_list_node *container)
+{
+    struct container_ns *ns = container->ns;
+    int slot = ida_alloc_range(&ns->status_ida, 0, ns->status_slots - 1, GFP_KERNEL);
+    if (slot < 0) {
+        container->slot = PCONTAINER_NO_SLOT;
+        return;
+    }
+    container->slot = slot;
+    WRITE_ONCE(ns->status[slot].cid, container->cid);
+}
+
+/**
+ * Release the entry of a container nobody can reach any more.
+ */
+void container_status_free(struct container_list_node *container)
+{
+    struct processor_container_status *status;
+    if (container->slot == PCONTAINER_NO_SLOT)
+        return;
+    status = &container->ns->status[container->slot];
+    WRITE_ONCE(status->nr_tasks, 0);
+    ida_free(&container->ns->status_ida, container->slot);
+}
+
+/**
+ * Publish the task count and the running slots of a container.
+ * Must be called with container->lock held.
+ */
+void container_status_update(struct container_list_node *container)
+{
+    struct processor_container_status *status;
+    if (container->slot == PCONTAINER_NO_SLOT)
+        return;
+    status = &container->ns->status[container->slot];
+    WRITE_ONCE(status->nr_tasks, container->nr_tasks);
+    WRITE_ONCE(status->concurrency, container_slots(container));
+}
+
+/**
+ * Map the status table of the caller's namespace, read-only, or the
+ * caller's command ring if it asks for PCONTAINER_RING_OFFSET. Mapping the
+ * table settles the namespace of the file, see container_file_ns().
+ */
+int processor_container_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+    struct container_ns *ns;
+    if (vma->vm_pgoff >= PCONTAINER_RING_OFFSET >> PAGE_SHIFT)
+        return processor_container_ring_mmap(filp, vma);
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+    ns = container_file_ns(filp);
+    if (vma->vm_end - vma->vm_start + (vma->vm_pgoff << PAGE_SHIFT) > status_table_size(ns))
+        return -EINVAL;
+    vm_flags_clear(vma, VM_MAYWRITE);
+    return remap_vmalloc_range(vma, ns->status, vma->vm_pgoff);
+}
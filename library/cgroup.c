@@ -0,0 +1,208 @@
+#include <processor_container/processor_container.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * cgroup v2 backend. Every container is a threaded cgroup below
+ * PCONTAINER_CGROUP_ROOT (default /sys/fs/cgroup/pcontainer), and CFS
+ * shares the CPU between them by itself, so nothing is ever switched from
+ * user space. Create and delete move the calling thread into the cgroup of
+ * the container and back into the root, shares map to cpu.weight, and the
+ * concurrency of a container to a cpu.max quota of that many CPUs.
+ *
+ * Only threads of one process can be moved between threaded cgroups, so
+ * the whole process moves into the root cgroup on first use. The parent of
+ * the root must have the cpu controller enabled in cgroup.subtree_control.
+ */
+#define CGROUP_PERIOD_US 100000
+
+static pthread_once_t cgroup_once = PTHREAD_ONCE_INIT;
+static int cgroup_error;            // errno of a failed setup, 0 if it worked
+static char cgroup_root[PATH_MAX - 32];  // leaves room for a cid and file name
+
+/**
+ * Write a formatted value into file name of the cgroup dir.
+ */
+static int cgroup_write(const char *dir, const char *name, const char *fmt, ...)
+{
+    char path[PATH_MAX], buf[64];
+    va_list ap;
+    FILE *f;
+    int ret;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (!(f = fopen(path, "w")))
+        return -1;
+    // cgroup files report errors on the write itself
+    ret = fputs(buf, f) < 0 || fflush(f) ? -1 : 0;
+    if (fclose(f) && !ret)
+        ret = -1;
+    return ret;
+}
+
+static void cgroup_path(char *path, __u64 cid)
+{
+    snprintf(path, PATH_MAX, "%s/%llu", cgroup_root, (unsigned long long)cid);
+}
+
+/**
+ * Set up the root cgroup once and move the process into it.
+ */
+static void cgroup_setup(void)
+{
+    const char *root = getenv("PCONTAINER_CGROUP_ROOT");
+
+    snprintf(cgroup_root, sizeof(cgroup_root), "%s", root ? root : "/sys/fs/cgroup/pcontainer");
+    if ((mkdir(cgroup_root, 0755) && errno != EEXIST) ||
+        cgroup_write(cgroup_root, "cgroup.procs", "%d", getpid()) ||
+        cgroup_write(cgroup_root, "cgroup.subtree_control", "+cpu"))
+        cgroup_error = errno;
+}
+
+/**
+ * Move the caller into the cgroup of cid, creating it if needed.
+ */
+static int cgroup_create(__u64 cid)
+{
+    char path[PATH_MAX];
+
+    cgroup_path(path, cid);
+    if (mkdir(path, 0755) == 0)
+    {
+        if (cgroup_write(path, "cgroup.type", "threaded"))
+            return -1;
+    }
+    else if (errno != EEXIST)
+        return -1;
+    if (cgroup_write(path, "cgroup.threads", "%ld", syscall(SYS_gettid)))
+        return -1;
+    return PCONTAINER_NO_SLOT;
+}
+
+/**
+ * Move the caller back into the root cgroup, and remove the cgroup of cid
+ * if that was its last thread.
+ */
+static int cgroup_delete(__u64 cid)
+{
+    char path[PATH_MAX];
+
+    cgroup_path(path, cid);
+    if (cgroup_write(cgroup_root, "cgroup.threads", "%ld", syscall(SYS_gettid)))
+        return -1;
+    // fails with EBUSY while other members are left
+    rmdir(path);
+    return 0;
+}
+
+/**
+ * Shares are CFS weights with 1024 for nice 0, cpu.weight uses 100 for it.
+ */
+static int cgroup_set_shares(__u64 cid, __u64 shares)
+{
+    char path[PATH_MAX];
+    __u64 weight = shares ? shares * 100 / 1024 : 100;
+
+    cgroup_path(path, cid);
+    if (weight < 1)
+        weight = 1;
+    if (weight > 10000)
+        weight = 10000;
+    return cgroup_write(path, "cpu.weight", "%llu", (unsigned long long)weight);
+}
+
+/**
+ * Running at most n members at once is a quota of n CPUs per period.
+ */
+static int cgroup_set_concurrency(__u64 cid, __u64 n)
+{
+    char path[PATH_MAX];
+
+    if (!n || n > INT_MAX)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    cgroup_path(path, cid);
+    return cgroup_write(path, "cpu.max", "%llu %d", (unsigned long long)n * CGROUP_PERIOD_US, CGROUP_PERIOD_US);
+}
+
+/**
+ * Fill in the member count and the CPU time of a container, which is all a
+ * cgroup keeps track of.
+ */
+static int cgroup_stats(struct processor_container_stats *stats)
+{
+    char path[PATH_MAX], line[128];
+    unsigned long long usec;
+    __u64 cid = stats->cid;
+    FILE *f;
+
+    cgroup_path(path, cid);
+    strncat(path, "/cgroup.threads", PATH_MAX - strlen(path) - 1);
+    if (!(f = fopen(path, "r")))
+        return -1;
+    memset(stats, 0, sizeof(*stats));
+    stats->cid = cid;
+    while (fgets(line, sizeof(line), f))
+        stats->nr_tasks++;
+    fclose(f);
+    cgroup_path(path, cid);
+    strncat(path, "/cpu.stat", PATH_MAX - strlen(path) - 1);
+    if ((f = fopen(path, "r")))
+    {
+        while (fgets(line, sizeof(line), f))
+            if (sscanf(line, "usage_usec %llu", &usec) == 1)
+                stats->runtime_ns = usec * 1000;
+        fclose(f);
+    }
+    return 0;
+}
+
+/**
+ * Run a command of the kernel module's ioctl interface on cgroups. A switch
+ * is a no-op since CFS rotates the members; commands without a cgroup
+ * counterpart fail with EOPNOTSUPP.
+ */
+int pcontainer_cgroup_ioctl(unsigned long request, void *arg)
+{
+    struct processor_container_cmd *cmd = (struct processor_container_cmd *)arg;
+    struct processor_container_param *param = (struct processor_container_param *)arg;
+
+    pthread_once(&cgroup_once, cgroup_setup);
+    if (cgroup_error)
+    {
+        errno = cgroup_error;
+        return -1;
+    }
+    switch (request)
+    {
+    case PCONTAINER_IOCTL_CREATE:
+        return cgroup_create(cmd->cid);
+    case PCONTAINER_IOCTL_DELETE:
+        return cgroup_delete(cmd->cid);
+    case PCONTAINER_IOCTL_CSWITCH:
+        return 0;
+    case PCONTAINER_IOCTL_SET_SHARES:
+        return cgroup_set_shares(param->cid, param->value);
+    case PCONTAINER_IOCTL_SET_CONCURRENCY:
+        return cgroup_set_concurrency(param->cid, param->value);
+    case PCONTAINER_IOCTL_STATS:
+        return cgroup_stats((struct processor_container_stats *)arg);
+    default:
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+}
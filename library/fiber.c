@@ -0,0 +1,307 @@
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <linux/types.h>
+
+// pcontainer.h defines the signal handler and pcontainer_init(), so only
+// pcontainer.c may include it
+int pcontainer_create(int devfd, __u64 cid);
+int pcontainer_delete(int devfd, __u64 cid);
+
+/**
+ * Fiber mode: the tasks of a container are user-level fibers multiplexed
+ * on one carrier thread, which is the only member the kernel module sees.
+ * Fibers switch among themselves in pcontainer_fiber_yield() without
+ * entering the kernel. The carrier joins the container when its first
+ * fiber is created and leaves it once the last fiber returned, so the
+ * container lives exactly as long as in kernel mode.
+ */
+#define PCONTAINER_FIBER_STACK (256 * 1024)
+
+struct pcontainer_fiber
+{
+    void *sp;                       // saved stack pointer while switched out
+    void *(*fn)(void *);
+    void *arg;
+    void *stack;                    // mapping including the guard page
+    struct pcontainer_fiber *next;  // run queue or incoming list
+};
+
+struct pcontainer_carrier
+{
+    int devfd;
+    __u64 cid;
+    int exiting;                    // no fiber left, about to leave the container
+    pthread_t thread;
+    void *sp;                       // the carrier's own context
+    struct pcontainer_fiber *head, *tail;   // run queue, carrier thread only
+    struct pcontainer_fiber *incoming;      // created by other threads, under carriers_lock
+    struct pcontainer_carrier *next;
+};
+
+static pthread_mutex_t carriers_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct pcontainer_carrier *carriers;
+static __thread struct pcontainer_carrier *fiber_carrier;
+static __thread struct pcontainer_fiber *fiber_current;
+
+#if defined(__x86_64__)
+#define PCONTAINER_FIBER_SWITCH 1
+
+/**
+ * Save the callee-saved registers and the FPU control words on the current
+ * stack, store the stack pointer in *save and resume the context whose
+ * stack pointer is to. A new context starts at the return address its
+ * initial stack holds.
+ */
+void pcontainer_fiber_switch(void **save, void *to);
+__asm__(
+    ".text\n"
+    ".globl pcontainer_fiber_switch\n"
+    ".type pcontainer_fiber_switch, @function\n"
+    "pcontainer_fiber_switch:\n"
+    "    pushq %rbp\n"
+    "    pushq %rbx\n"
+    "    pushq %r12\n"
+    "    pushq %r13\n"
+    "    pushq %r14\n"
+    "    pushq %r15\n"
+    "    subq $8, %rsp\n"
+    "    stmxcsr (%rsp)\n"
+    "    fnstcw 4(%rsp)\n"
+    "    movq %rsp, (%rdi)\n"
+    "    movq %rsi, %rsp\n"
+    "    ldmxcsr (%rsp)\n"
+    "    fldcw 4(%rsp)\n"
+    "    addq $8, %rsp\n"
+    "    popq %r15\n"
+    "    popq %r14\n"
+    "    popq %r13\n"
+    "    popq %r12\n"
+    "    popq %rbx\n"
+    "    popq %rbp\n"
+    "    ret\n"
+    ".size pcontainer_fiber_switch, .-pcontainer_fiber_switch\n");
+#else
+// no context switch for this architecture yet: pcontainer_fiber_create()
+// fails with ENOSYS, so this is never called
+#define PCONTAINER_FIBER_SWITCH 0
+
+static void pcontainer_fiber_switch(void **save, void *to)
+{
+    (void)save;
+    (void)to;
+    abort();
+}
+#endif
+
+/**
+ * Put a fiber at the tail of the run queue of its carrier.
+ */
+static void fiber_enqueue(struct pcontainer_carrier *c, struct pcontainer_fiber *f)
+{
+    f->next = NULL;
+    if (c->tail)
+        c->tail->next = f;
+    else
+        c->head = f;
+    c->tail = f;
+}
+
+static struct pcontainer_fiber *fiber_dequeue(struct pcontainer_carrier *c)
+{
+    struct pcontainer_fiber *f = c->head;
+    if (f && !(c->head = f->next))
+        c->tail = NULL;
+    return f;
+}
+
+/**
+ * Move fibers created by other threads onto the run queue, oldest first.
+ */
+static void fiber_take_incoming(struct pcontainer_carrier *c)
+{
+    struct pcontainer_fiber *f, *rev = NULL;
+    if (!__atomic_load_n(&c->incoming, __ATOMIC_ACQUIRE))
+        return;
+    pthread_mutex_lock(&carriers_lock);
+    f = c->incoming;
+    c->incoming = NULL;
+    pthread_mutex_unlock(&carriers_lock);
+    while (f)
+    {
+        struct pcontainer_fiber *next = f->next;
+        f->next = rev;
+        rev = f;
+        f = next;
+    }
+    while (rev)
+    {
+        f = rev->next;
+        fiber_enqueue(c, rev);
+        rev = f;
+    }
+}
+
+/**
+ * First code a fiber runs; it returns to the carrier when fn is done,
+ * which frees the fiber since nothing may run on a stack being unmapped.
+ */
+static void fiber_start(void)
+{
+    struct pcontainer_fiber *f = fiber_current;
+    f->fn(f->arg);
+    pcontainer_fiber_switch(&f->sp, fiber_carrier->sp);
+}
+
+/**
+ * Body of a carrier thread: joins the container and runs the fibers round
+ * robin until none is left, then leaves it.
+ */
+static void *carrier_body(void *x)
+{
+    struct pcontainer_carrier *c = (struct pcontainer_carrier *)x;
+    struct pcontainer_fiber *f;
+
+    fiber_carrier = c;
+    pcontainer_create(c->devfd, c->cid);
+    for (;;)
+    {
+        fiber_take_incoming(c);
+        if (!(f = fiber_dequeue(c)))
+        {
+            // later creators start a new carrier once this one is exiting
+            pthread_mutex_lock(&carriers_lock);
+            if (!c->incoming)
+                c->exiting = 1;
+            pthread_mutex_unlock(&carriers_lock);
+            if (c->exiting)
+                break;
+            continue;
+        }
+        fiber_current = f;
+        pcontainer_fiber_switch(&c->sp, f->sp);
+        // back here only when a fiber finished, yields go fiber to fiber
+        f = fiber_current;
+        munmap(f->stack, PCONTAINER_FIBER_STACK);
+        free(f);
+    }
+    pcontainer_delete(c->devfd, c->cid);
+    return NULL;
+}
+
+/**
+ * Create a fiber running fn(arg) in container cid. Like a thread that
+ * calls pcontainer_create(), it is a member of the container until fn
+ * returns. Fibers must not call pcontainer_create() or
+ * pcontainer_delete() themselves. Fails with ENOSYS on architectures
+ * without a fiber context switch.
+ */
+int pcontainer_fiber_create(int devfd, __u64 cid, void *(*fn)(void *), void *arg)
+{
+    struct pcontainer_carrier *c;
+    struct pcontainer_fiber *f;
+    void **sp;
+
+    if (!PCONTAINER_FIBER_SWITCH)
+    {
+        errno = ENOSYS;
+        return -1;
+    }
+    f = (struct pcontainer_fiber *) calloc(1, sizeof(*f));
+    if (!f)
+        return -1;
+    f->stack = mmap(NULL, PCONTAINER_FIBER_STACK, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if (f->stack == MAP_FAILED)
+    {
+        free(f);
+        return -1;
+    }
+    // the lowest page catches stack overflows
+    mprotect(f->stack, getpagesize(), PROT_NONE);
+    f->fn = fn;
+    f->arg = arg;
+    // initial frame popped by pcontainer_fiber_switch(): control words,
+    // six callee-saved registers and fiber_start() as return address,
+    // which then sees the stack aligned as after a call
+    sp = (void **)((char *)f->stack + PCONTAINER_FIBER_STACK);
+    *--sp = NULL;
+    *--sp = (void *)fiber_start;
+    sp -= 6;
+    memset(sp, 0, 6 * sizeof(void *));
+    *--sp = (void *)(0x037fULL << 32 | 0x1f80);
+    f->sp = sp;
+
+    pthread_mutex_lock(&carriers_lock);
+    for (c = carriers; c; c = c->next)
+        if (c->cid == cid && c->devfd == devfd && !c->exiting)
+            break;
+    if (!c)
+    {
+        c = (struct pcontainer_carrier *) calloc(1, sizeof(*c));
+        if (c)
+        {
+            c->devfd = devfd;
+            c->cid = cid;
+        }
+        // the new carrier cannot give up before the fiber is queued below,
+        // it checks for incoming fibers under carriers_lock
+        if (!c || pthread_create(&c->thread, NULL, carrier_body, c))
+        {
+            pthread_mutex_unlock(&carriers_lock);
+            free(c);
+            munmap(f->stack, PCONTAINER_FIBER_STACK);
+            free(f);
+            return -1;
+        }
+        c->next = carriers;
+        carriers = c;
+    }
+    f->next = c->incoming;
+    __atomic_store_n(&c->incoming, f, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&carriers_lock);
+    return 0;
+}
+
+/**
+ * Switch to the next fiber of the caller's container, if there is one.
+ * This never enters the kernel.
+ */
+void pcontainer_fiber_yield(void)
+{
+    struct pcontainer_carrier *c = fiber_carrier;
+    struct pcontainer_fiber *self = fiber_current, *next;
+
+    if (!c || !self)
+        return;
+    fiber_take_incoming(c);
+    if (!(next = fiber_dequeue(c)))
+        return;
+    fiber_enqueue(c, self);
+    fiber_current = next;
+    pcontainer_fiber_switch(&self->sp, next->sp);
+}
+
+/**
+ * Wait until every fiber created so far has returned and its container's
+ * carrier has left the container.
+ */
+int pcontainer_fiber_join(void)
+{
+    struct pcontainer_carrier *c;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&carriers_lock);
+        if ((c = carriers))
+            carriers = c->next;
+        pthread_mutex_unlock(&carriers_lock);
+        if (!c)
+            return 0;
+        pthread_join(c->thread, NULL);
+        free(c);
+    }
+}
@@ -1,34 +1,374 @@
 #include "pcontainer.h"
 
+volatile struct processor_container_status *pcontainer_status;
+unsigned int pcontainer_status_slots = PCONTAINER_STATUS_SLOTS;
+__thread unsigned int pcontainer_slot = PCONTAINER_NO_SLOT;
+
+int pcontainer_usched_ioctl(unsigned long request, void *arg);
+int pcontainer_cgroup_ioctl(unsigned long request, void *arg);
+
+#define PCONTAINER_BACKEND_KERNEL 0
+#define PCONTAINER_BACKEND_USER 1       // usched.c
+#define PCONTAINER_BACKEND_CGROUP 2     // cgroup.c
+
+/**
+ * the backend PCONTAINER_BACKEND selects: "user" for the user space
+ * scheduler, "cgroup" for cgroup v2, the kernel module otherwise. Read
+ * once, on first use.
+ */
+static int pcontainer_backend(void)
+{
+    static int backend = -1;
+    const char *name;
+    if (backend < 0)
+    {
+        name = getenv("PCONTAINER_BACKEND");
+        if (name && strcmp(name, "user") == 0)
+            backend = PCONTAINER_BACKEND_USER;
+        else if (name && strcmp(name, "cgroup") == 0)
+            backend = PCONTAINER_BACKEND_CGROUP;
+        else
+            backend = PCONTAINER_BACKEND_KERNEL;
+    }
+    return backend;
+}
+
+/**
+ * send a command to the kernel module, or run it in the selected backend.
+ */
+static int pcontainer_ioctl(int devfd, unsigned long request, void *arg)
+{
+    switch (pcontainer_backend())
+    {
+    case PCONTAINER_BACKEND_USER:
+        return pcontainer_usched_ioctl(request, arg);
+    case PCONTAINER_BACKEND_CGROUP:
+        return pcontainer_cgroup_ioctl(request, arg);
+    default:
+        return ioctl(devfd, request, arg);
+    }
+}
+
+/**
+ * open the kernel module. The other backends do not need it, and a
+ * descriptor of /dev/null stands in for it.
+ */
+int pcontainer_open(void)
+{
+    if (pcontainer_backend() != PCONTAINER_BACKEND_KERNEL)
+        return open("/dev/null", O_RDWR);
+    return open("/dev/pcontainer", O_RDWR);
+}
+
+/**
+ * give devfd a container namespace of its own, so that its cids neither
+ * collide nor share locks or status entries with those of other
+ * descriptors. Has to be done right after pcontainer_open(), once per
+ * descriptor and before pcontainer_init(), which maps the status table of
+ * the namespace.
+ */
+int pcontainer_new_ns(int devfd)
+{
+    int slots = pcontainer_ioctl(devfd, PCONTAINER_IOCTL_NEW_NS, NULL);
+    if (slots <= 0)
+        return slots;
+    pcontainer_status_slots = slots;
+    return 0;
+}
+
 /**
  * context switch handler in user space that sends command to kernel space
  * for switch tasks and containers.
  */
-int pcontainer_context_switch_handler(int devfd, int id)
+int pcontainer_context_switch_handler(int devfd, __u64 id)
 {
     struct processor_container_cmd cmd;
     cmd.cid = id;
-    return ioctl(devfd, PCONTAINER_IOCTL_CSWITCH, &cmd);
+    return pcontainer_ioctl(devfd, PCONTAINER_IOCTL_CSWITCH, &cmd);
 }
 
 /**
  * delete function in user space that sends command to kernel space
  * for deleting the current task in specified container.
  */
-int pcontainer_delete(int devfd, int id)
+int pcontainer_delete(int devfd, __u64 id)
 {
     struct processor_container_cmd cmd;
     cmd.cid = id;
-    return ioctl(devfd, PCONTAINER_IOCTL_DELETE, &cmd);
+    // the slot cannot be reused before we leave, so its cid is still ours
+    if (pcontainer_status && pcontainer_slot < PCONTAINER_STATUS_SLOTS &&
+        pcontainer_status[pcontainer_slot].cid == id)
+        pcontainer_slot = PCONTAINER_NO_SLOT;
+    return pcontainer_ioctl(devfd, PCONTAINER_IOCTL_DELETE, &cmd);
 }
 
 /**
  * create function in user space that sends command to kernel space
  * for creating the current task in specified container.
  */
-int pcontainer_create(int devfd, int id)
+int pcontainer_create(int devfd, __u64 id)
 {
     struct processor_container_cmd cmd;
+    int slot;
     cmd.cid = id;
-    return ioctl(devfd, PCONTAINER_IOCTL_CREATE, &cmd);
+    slot = pcontainer_ioctl(devfd, PCONTAINER_IOCTL_CREATE, &cmd);
+    if (slot < 0)
+        return slot;
+    // remember where the handler finds our container in the status table
+    pcontainer_slot = slot;
+    return 0;
+}
+
+/**
+ * set the time slice of the specified container in nanoseconds, 0 disables
+ * the kernel timer for it.
+ */
+int pcontainer_set_quantum(int devfd, __u64 id, unsigned long long quantum_ns)
+{
+    struct processor_container_param param;
+    param.cid = id;
+    param.value = quantum_ns;
+    return pcontainer_ioctl(devfd, PCONTAINER_IOCTL_SET_QUANTUM, &param);
+}
+
+/**
+ * set the CPU shares of the specified container, 1024 is the default weight
+ * and 0 turns weighting off.
+ */
+int pcontainer_set_shares(int devfd, __u64 id, unsigned long long shares)
+{
+    struct processor_container_param param;
+    param.cid = id;
+    param.value = shares;
+    return pcontainer_ioctl(devfd, PCONTAINER_IOCTL_SET_SHARES, &param);
+}
+
+/**
+ * set how many tasks of the specified container may run at the same time,
+ * the default is 1.
+ */
+int pcontainer_set_concurrency(int devfd, __u64 id, unsigned long long concurrency)
+{
+    struct processor_container_param param;
+    param.cid = id;
+    param.value = concurrency;
+    return pcontainer_ioctl(devfd, PCONTAINER_IOCTL_SET_CONCURRENCY, &param);
+}
+
+/**
+ * turn gang mode of the specified container on or off. All tasks of a gang
+ * container run at the same time, and gang containers take turns.
+ */
+int pcontainer_set_gang(int devfd, __u64 id, int gang)
+{
+    struct processor_container_param param;
+    param.cid = id;
+    param.value = gang != 0;
+    return pcontainer_ioctl(devfd, PCONTAINER_IOCTL_SET_GANG, &param);
+}
+
+/**
+ * turn the adaptive time slice of the specified container on or off. The
+ * slice then grows while tasks use all of it and shrinks when they switch
+ * early, around the quantum set with pcontainer_set_quantum().
+ */
+int pcontainer_set_adaptive(int devfd, __u64 id, int adaptive)
+{
+    struct processor_container_param param;
+    param.cid = id;
+    param.value = adaptive != 0;
+    return pcontainer_ioctl(devfd, PCONTAINER_IOCTL_SET_ADAPTIVE, &param);
+}
+
+/**
+ * report the specified container to the watchers of
+ * PCONTAINER_EVENT_STARVED once its tasks got no CPU for starve_ns while
+ * wanting to run. 0 turns it off.
+ */
+int pcontainer_set_starve(int devfd, __u64 id, unsigned long long starve_ns)
+{
+    struct processor_container_param param;
+    param.cid = id;
+    param.value = starve_ns;
+    return pcontainer_ioctl(devfd, PCONTAINER_IOCTL_SET_STARVE, &param);
+}
+
+/**
+ * restrict the tasks of the specified container to the CPUs in mask, given
+ * like for sched_setaffinity(), and to those of NUMA node if it is not -1.
+ * An empty mask and node -1 let them run anywhere again.
+ */
+int pcontainer_set_cpus(int devfd, __u64 id, size_t size, const void *mask, int node)
+{
+    struct processor_container_cpus param;
+    memset(&param, 0, sizeof(param));
+    param.cid = id;
+    param.node = node;
+    if (mask)
+        memcpy(param.mask, mask, size < sizeof(param.mask) ? size : sizeof(param.mask));
+    return pcontainer_ioctl(devfd, PCONTAINER_IOCTL_SET_CPUS, &param);
+}
+
+/**
+ * read the runtime statistics of the specified container.
+ */
+int pcontainer_stats(int devfd, __u64 id, struct processor_container_stats *stats)
+{
+    stats->cid = id;
+    return pcontainer_ioctl(devfd, PCONTAINER_IOCTL_STATS, stats);
+}
+
+/**
+ * queue the events of the specified container, or of all containers if id
+ * is PCONTAINER_WATCH_ALL, whose bit 1 << PCONTAINER_EVENT_* is set in mask on devfd. They
+ * are read with pcontainer_read_events(), and poll() on devfd reports
+ * POLLIN while some are queued. An empty mask stops the queueing.
+ */
+int pcontainer_watch(int devfd, __u64 id, unsigned int mask)
+{
+    struct processor_container_param param;
+    param.cid = id;
+    param.value = mask;
+    return pcontainer_ioctl(devfd, PCONTAINER_IOCTL_WATCH, &param);
+}
+
+/**
+ * read up to n queued events of devfd, waiting for the first one unless
+ * devfd is non-blocking. Returns the number of events read.
+ */
+int pcontainer_read_events(int devfd, struct processor_container_event *events, int n)
+{
+    ssize_t ret = read(devfd, events, n * sizeof(*events));
+    return ret < 0 ? -1 : (int)(ret / sizeof(*events));
+}
+
+/**
+ * put thread tid into the specified container without its cooperation. It
+ * waits in its SIGPROF handler until it gets the slice.
+ */
+int pcontainer_attach(int devfd, __u64 id, pid_t tid)
+{
+    struct processor_container_param param;
+    param.cid = id;
+    param.value = tid;
+    return pcontainer_ioctl(devfd, PCONTAINER_IOCTL_ATTACH, &param);
+}
+
+/**
+ * put every thread of process pid into the specified container, returns the
+ * number of threads attached.
+ */
+int pcontainer_attach_group(int devfd, __u64 id, pid_t pid)
+{
+    struct processor_container_param param;
+    param.cid = id;
+    param.value = pid;
+    return pcontainer_ioctl(devfd, PCONTAINER_IOCTL_ATTACH_GROUP, &param);
+}
+
+/**
+ * move thread tid from one container to another in a single step.
+ */
+int pcontainer_migrate(int devfd, __u64 from, __u64 to, pid_t tid)
+{
+    struct processor_container_migrate migrate;
+    migrate.from = from;
+    migrate.to = to;
+    migrate.tid = tid;
+    migrate.pad = 0;
+    return pcontainer_ioctl(devfd, PCONTAINER_IOCTL_MIGRATE, &migrate);
+}
+
+/**
+ * acquire the container-aware lock with the specified id. The caller keeps
+ * its time slice until it releases the lock.
+ */
+int pcontainer_lock(int devfd, __u64 lock_id)
+{
+    struct processor_container_cmd cmd;
+    cmd.cid = lock_id;
+    return pcontainer_ioctl(devfd, PCONTAINER_IOCTL_LOCK, &cmd);
+}
+
+/**
+ * release the lock with the specified id and hand it to the oldest waiter.
+ */
+int pcontainer_unlock(int devfd, __u64 lock_id)
+{
+    struct processor_container_cmd cmd;
+    cmd.cid = lock_id;
+    return pcontainer_ioctl(devfd, PCONTAINER_IOCTL_UNLOCK, &cmd);
+}
+
+/**
+ * map the command ring of devfd. Commands are queued with
+ * pcontainer_ring_queue() and run by pcontainer_ring_submit(); only one
+ * thread at a time may queue or reap on a ring.
+ */
+struct processor_container_ring *pcontainer_ring_init(int devfd)
+{
+    void *ring = mmap(NULL, sizeof(struct processor_container_ring), PROT_READ | PROT_WRITE,
+                      MAP_SHARED, devfd, PCONTAINER_RING_OFFSET);
+    return ring == MAP_FAILED ? NULL : (struct processor_container_ring *)ring;
+}
+
+/**
+ * fill in the next submission queue entry and publish it, returns -1 if the
+ * submission queue is full.
+ */
+static int pcontainer_ring_push(struct processor_container_ring *ring, int op, __u64 cid, __u64 to,
+                                unsigned long long value, unsigned long long user_data)
+{
+    struct processor_container_sqe *sqe;
+    __u32 tail = ring->sq_tail;
+    if (tail - __atomic_load_n(&ring->sq_head, __ATOMIC_ACQUIRE) == PCONTAINER_RING_ENTRIES)
+        return -1;
+    sqe = &ring->sq[tail % PCONTAINER_RING_ENTRIES];
+    sqe->op = op;
+    sqe->cid = cid;
+    sqe->value = value;
+    sqe->user_data = user_data;
+    sqe->to = to;
+    __atomic_store_n(&ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+/**
+ * queue one command, returns -1 if the submission queue is full.
+ */
+int pcontainer_ring_queue(struct processor_container_ring *ring, int op, __u64 cid,
+                          unsigned long long value, unsigned long long user_data)
+{
+    return pcontainer_ring_push(ring, op, cid, 0, value, user_data);
+}
+
+/**
+ * queue a PCONTAINER_OP_MIGRATE of thread tid from one container to
+ * another, returns -1 if the submission queue is full.
+ */
+int pcontainer_ring_queue_migrate(struct processor_container_ring *ring, __u64 from, __u64 to,
+                                  pid_t tid, unsigned long long user_data)
+{
+    return pcontainer_ring_push(ring, PCONTAINER_OP_MIGRATE, from, to, tid, user_data);
+}
+
+/**
+ * run the queued commands, returns how many of them completed.
+ */
+int pcontainer_ring_submit(int devfd)
+{
+    return pcontainer_ioctl(devfd, PCONTAINER_IOCTL_SUBMIT, NULL);
+}
+
+/**
+ * take the oldest completion off the ring, returns 0 if there is none.
+ */
+int pcontainer_ring_reap(struct processor_container_ring *ring, struct processor_container_cqe *cqe)
+{
+    __u32 head = ring->cq_head;
+    if (head == __atomic_load_n(&ring->cq_tail, __ATOMIC_ACQUIRE))
+        return 0;
+    *cqe = ring->cq[head % PCONTAINER_RING_ENTRIES];
+    __atomic_store_n(&ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    return 1;
 }
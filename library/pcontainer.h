@@ -13,29 +13,84 @@ extern "C"
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <fcntl.h>
 
-    int pcontainer_delete(int devfd, int cid);
-    int pcontainer_create(int devfd, int cid);
-    int pcontainer_context_switch_handler(int devfd, int cid);
+    int pcontainer_open(void);
+    int pcontainer_new_ns(int devfd);
+    int pcontainer_delete(int devfd, __u64 cid);
+    int pcontainer_create(int devfd, __u64 cid);
+    int pcontainer_context_switch_handler(int devfd, __u64 cid);
+    int pcontainer_set_quantum(int devfd, __u64 cid, unsigned long long quantum_ns);
+    int pcontainer_set_shares(int devfd, __u64 cid, unsigned long long shares);
+    int pcontainer_set_concurrency(int devfd, __u64 cid, unsigned long long concurrency);
+    int pcontainer_set_gang(int devfd, __u64 cid, int gang);
+    int pcontainer_set_adaptive(int devfd, __u64 cid, int adaptive);
+    int pcontainer_set_starve(int devfd, __u64 cid, unsigned long long starve_ns);
+    int pcontainer_set_cpus(int devfd, __u64 cid, size_t size, const void *mask, int node);
+    int pcontainer_stats(int devfd, __u64 cid, struct processor_container_stats *stats);
+    int pcontainer_watch(int devfd, __u64 cid, unsigned int mask);
+    int pcontainer_read_events(int devfd, struct processor_container_event *events, int n);
+    int pcontainer_attach(int devfd, __u64 cid, pid_t tid);
+    int pcontainer_attach_group(int devfd, __u64 cid, pid_t pid);
+    int pcontainer_migrate(int devfd, __u64 from, __u64 to, pid_t tid);
+    int pcontainer_lock(int devfd, __u64 lock_id);
+    int pcontainer_unlock(int devfd, __u64 lock_id);
+    struct processor_container_ring *pcontainer_ring_init(int devfd);
+    int pcontainer_ring_queue(struct processor_container_ring *ring, int op, __u64 cid,
+                              unsigned long long value, unsigned long long user_data);
+    int pcontainer_ring_queue_migrate(struct processor_container_ring *ring, __u64 from, __u64 to,
+                                      pid_t tid, unsigned long long user_data);
+    int pcontainer_ring_submit(int devfd);
+    int pcontainer_ring_reap(struct processor_container_ring *ring, struct processor_container_cqe *cqe);
+    int pcontainer_fiber_create(int devfd, __u64 cid, void *(*fn)(void *), void *arg);
+    void pcontainer_fiber_yield(void);
+    int pcontainer_fiber_join(void);
     int pcontainer_init(int devfd);
     int DEVFD;
 
+    // the status table of the kernel module, its number of entries, and the
+    // slot of the container the calling thread joined last
+    extern volatile struct processor_container_status *pcontainer_status;
+    extern unsigned int pcontainer_status_slots;
+    extern __thread unsigned int pcontainer_slot;
+
     /**
      * handler function for the timer to run the context switch function.
+     * The kernel finds the caller's container by itself, so no cid is needed.
+     * The syscall is skipped for the end of a slice when the status table
+     * shows that nobody in the container waits for a running slot. Any other
+     * SIGPROF of the module means the caller was moved, attached or parked,
+     * so the call is made and returns the slot of its container.
      */
-    static void handler()
+    static void handler(int sig, siginfo_t *info, void *context)
     {
-        pcontainer_context_switch_handler(DEVFD, 0);
+        volatile struct processor_container_status *status;
+        int slot;
+        (void)sig;
+        (void)context;
+        if (pcontainer_status && info->si_code == SI_KERNEL && pcontainer_slot < PCONTAINER_STATUS_SLOTS)
+        {
+            status = &pcontainer_status[pcontainer_slot];
+            if (status->nr_tasks <= status->concurrency)
+                return;
+        }
+        slot = pcontainer_context_switch_handler(DEVFD, 0);
+        if (pcontainer_status && slot >= 0)
+            pcontainer_slot = slot;
     }
 
     /**
-     * set up the alarm for context switch every time duration.
+     * set up the handler for context switch requests. The kernel module sends
+     * SIGPROF to the running task of a container when its time slice is over;
+     * setting PCONTAINER_ITIMER in the environment additionally arms the old
+     * process-wide profiling timer that fires every time duration.
      */
     int pcontainer_init(int devfd)
     {
         struct sigaction sa;
         struct itimerval timeout;
+        void *status;
 
         sa.sa_flags = SA_SIGINFO | SA_RESTART | SA_ONSTACK;
         sigemptyset(&sa.sa_mask);
@@ -47,6 +102,15 @@ extern "C"
         }
 
         DEVFD = devfd;
+        // an older module without mmap support just loses the fast path,
+        // PCONTAINER_NO_STATUS turns it off for comparison
+        status = MAP_FAILED;
+        if (!getenv("PCONTAINER_NO_STATUS"))
+            status = mmap(NULL, pcontainer_status_slots * sizeof(struct processor_container_status),
+                          PROT_READ, MAP_SHARED, devfd, 0);
+        pcontainer_status = status == MAP_FAILED ? NULL : (struct processor_container_status *)status;
+        if (!getenv("PCONTAINER_ITIMER"))
+            return 0;
         timeout.it_value.tv_sec = 0;
         timeout.it_value.tv_usec = 5;
         timeout.it_interval = timeout.it_value;
@@ -0,0 +1,596 @@
+#include <processor_container/processor_container.h>
+#include <sys/ioctl.h>
+#include <errno.h>
+#include <limits.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+/**
+ * User space scheduler backend. It implements the create, delete, switch,
+ * quantum, adaptive slice, concurrency and stats commands of the kernel module within one
+ * process, with the same semantics as kernel_module/src/ioctl.c: a
+ * container lets concurrency members run, the others park until a running
+ * member switches or leaves, and a timer thread sends SIGPROF to a running
+ * member when its slice is over while others wait. Waiting members park on
+ * a futex in their own node. All state is protected by usched_lock.
+ */
+#define USCHED_BUCKETS 1024
+#define PCONTAINER_ADAPTIVE_RANGE 8     // as in processor_container_internal.h
+
+struct usched_list
+{
+    struct usched_list *prev, *next;
+};
+
+struct usched_task
+{
+    struct usched_list list;            // on running_head or task_head
+    struct usched_container *container;
+    pthread_t thread;
+    int running;                        // futex word, holds a running slot
+    long long deadline;                 // end of the slice, 0 if no timer is armed
+    int expired;                        // its slice ran out since it last got a slot
+    long long woken_at;                 // when it was handed a slot, 0 once it ran
+    long long exec_mark;                // thread CPU time at the last accounting
+    struct usched_task *thread_next;    // other memberships of the same thread
+};
+
+struct usched_container
+{
+    __u64 cid;
+    struct usched_container *hash_next;
+    struct usched_list all;             // linkage in usched_containers
+    struct usched_list running_head;    // members holding a running slot
+    struct usched_list task_head;       // waiting members, the next to run first
+    int nr_tasks;
+    int nr_running;
+    int concurrency;
+    __u64 quantum_ns;
+    __u64 slice_ns;                     // quantum_ns unless adaptive
+    int adaptive;
+    __u64 switches;
+    __u64 wakeups;
+    __u64 runtime_ns;
+    __u64 latency_hist[PCONTAINER_LATENCY_BUCKETS];
+};
+
+static pthread_mutex_t usched_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t usched_timer_cond;
+static pthread_once_t usched_once = PTHREAD_ONCE_INIT;
+static struct usched_container *usched_table[USCHED_BUCKETS];
+static struct usched_list usched_containers = { &usched_containers, &usched_containers };
+
+// the memberships of the calling thread; a switch request that arrives
+// from the signal handler while the thread is inside the backend is held
+// back until it leaves, like a kernel task holding locks
+static __thread struct usched_task *usched_self;
+static __thread volatile int usched_busy;
+static __thread volatile int usched_pending;
+
+static void list_init(struct usched_list *head)
+{
+    head->prev = head->next = head;
+}
+
+static void list_add_tail(struct usched_list *node, struct usched_list *head)
+{
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+static void list_del(struct usched_list *node)
+{
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+}
+
+#define list_task(node) ((struct usched_task *)(node))
+
+/**
+ * monotonic clock in nanoseconds.
+ */
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static long long thread_cpu_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void futex_wait(int *addr, int value)
+{
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, value, NULL, NULL, 0);
+}
+
+static void futex_wake(int *addr)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/**
+ * Timer thread: signals every running member whose slice is over while its
+ * container is oversubscribed, and sleeps until the next slice ends.
+ */
+static void *usched_timer(void *x)
+{
+    struct usched_container *container;
+    struct usched_list *c, *t;
+    struct usched_task *task;
+    struct timespec ts;
+    long long now, next;
+
+    (void)x;
+    pthread_mutex_lock(&usched_lock);
+    for (;;)
+    {
+        now = now_ns();
+        next = LLONG_MAX;
+        for (c = usched_containers.next; c != &usched_containers; c = c->next)
+        {
+            container = (struct usched_container *)((char *)c - offsetof(struct usched_container, all));
+            for (t = container->running_head.next; t != &container->running_head; t = t->next)
+            {
+                task = list_task(t);
+                if (!task->deadline)
+                    continue;
+                if (task->deadline <= now)
+                {
+                    task->deadline = 0;
+                    task->expired = 1;
+                    pthread_kill(task->thread, SIGPROF);
+                }
+                else if (task->deadline < next)
+                    next = task->deadline;
+            }
+        }
+        if (next == LLONG_MAX)
+            pthread_cond_wait(&usched_timer_cond, &usched_lock);
+        else
+        {
+            ts.tv_sec = next / 1000000000LL;
+            ts.tv_nsec = next % 1000000000LL;
+            pthread_cond_timedwait(&usched_timer_cond, &usched_lock, &ts);
+        }
+    }
+    return NULL;
+}
+
+static void usched_start(void)
+{
+    pthread_condattr_t attr;
+    pthread_t thread;
+    sigset_t all, old;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&usched_timer_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    // the timer thread itself must never take SIGPROF
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    pthread_create(&thread, NULL, usched_timer, NULL);
+    pthread_detach(thread);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+/**
+ * Check whether some running member should give up its slot.
+ * Must be called with usched_lock held.
+ */
+static int container_oversubscribed(struct usched_container *container)
+{
+    return container->task_head.next != &container->task_head ||
+           container->nr_running > container->concurrency;
+}
+
+/**
+ * Arm the slice of every running member that has none while the container
+ * is oversubscribed, and disarm them all otherwise.
+ * Must be called with usched_lock held.
+ */
+static void container_update_timers(struct usched_container *container)
+{
+    struct usched_list *t;
+    int arm = container->slice_ns && container_oversubscribed(container), armed = 0;
+
+    for (t = container->running_head.next; t != &container->running_head; t = t->next)
+    {
+        if (!arm)
+            list_task(t)->deadline = 0;
+        else if (!list_task(t)->deadline)
+        {
+            list_task(t)->deadline = now_ns() + container->slice_ns;
+            armed = 1;
+        }
+    }
+    if (armed)
+        pthread_cond_signal(&usched_timer_cond);
+}
+
+/**
+ * In adaptive mode, double the slice when the task used all of it and halve
+ * it when it switched early, like container_adapt_slice() in the module.
+ * Must be called with usched_lock held.
+ */
+static void container_adapt_slice(struct usched_container *container, struct usched_task *task)
+{
+    int expired = task->expired;
+    task->expired = 0;
+    if (!container->adaptive || !container->quantum_ns)
+        return;
+    if (expired && container->slice_ns * 2 <= container->quantum_ns * PCONTAINER_ADAPTIVE_RANGE)
+        container->slice_ns *= 2;
+    else if (!expired && container->slice_ns / 2 >= container->quantum_ns / PCONTAINER_ADAPTIVE_RANGE)
+        container->slice_ns /= 2;
+}
+
+/**
+ * Fill the free running slots with the members that waited longest and
+ * unpark them. Must be called with usched_lock held.
+ */
+static void container_run_next(struct usched_container *container)
+{
+    struct usched_task *next;
+
+    while (container->nr_running < container->concurrency && container->task_head.next != &container->task_head)
+    {
+        next = list_task(container->task_head.next);
+        list_del(&next->list);
+        list_add_tail(&next->list, &container->running_head);
+        container->nr_running++;
+        container->wakeups++;
+        next->woken_at = now_ns();
+        __atomic_store_n(&next->running, 1, __ATOMIC_RELEASE);
+        futex_wake(&next->running);
+    }
+    container_update_timers(container);
+}
+
+/**
+ * Charge the CPU time the caller used since the last call to its container.
+ * Must be called with usched_lock held, by the member itself.
+ */
+static void task_account(struct usched_task *task)
+{
+    long long exec = thread_cpu_ns();
+    task->container->runtime_ns += exec - task->exec_mark;
+    task->exec_mark = exec;
+}
+
+/**
+ * Park the caller until it is handed a running slot, then record how long
+ * that took. Called without usched_lock held.
+ */
+static void task_park(struct usched_task *task)
+{
+    struct usched_container *container;
+    long long latency;
+    unsigned int bucket = 0;
+
+    while (!__atomic_load_n(&task->running, __ATOMIC_ACQUIRE))
+        futex_wait(&task->running, 0);
+    // a switch request from an earlier slice is stale now
+    usched_pending = 0;
+    pthread_mutex_lock(&usched_lock);
+    container = task->container;
+    if (task->woken_at)
+    {
+        latency = (now_ns() - task->woken_at) / 1000;
+        while (latency && bucket < PCONTAINER_LATENCY_BUCKETS - 1)
+        {
+            latency >>= 1;
+            bucket++;
+        }
+        container->latency_hist[bucket]++;
+        task->woken_at = 0;
+    }
+    task->exec_mark = thread_cpu_ns();
+    pthread_mutex_unlock(&usched_lock);
+}
+
+static struct usched_container *container_lookup(__u64 cid)
+{
+    struct usched_container *container;
+
+    for (container = usched_table[cid % USCHED_BUCKETS]; container; container = container->hash_next)
+        if (container->cid == cid)
+            return container;
+    return NULL;
+}
+
+static struct usched_task *self_find(__u64 cid)
+{
+    struct usched_task *task;
+
+    for (task = usched_self; task; task = task->thread_next)
+        if (task->container->cid == cid)
+            return task;
+    return NULL;
+}
+
+/**
+ * Join container cid, creating it if needed, and wait for a running slot.
+ */
+static int usched_create(__u64 cid)
+{
+    struct usched_container *container, *new_container = NULL;
+    struct usched_task *task;
+    int running;
+
+    pthread_once(&usched_once, usched_start);
+    pthread_mutex_lock(&usched_lock);
+    if (self_find(cid))
+    {
+        pthread_mutex_unlock(&usched_lock);
+        errno = EEXIST;
+        return -1;
+    }
+    task = (struct usched_task *) calloc(1, sizeof(*task));
+    if (!(container = container_lookup(cid)))
+        container = new_container = (struct usched_container *) calloc(1, sizeof(*container));
+    if (!task || !container)
+    {
+        pthread_mutex_unlock(&usched_lock);
+        free(task);
+        free(new_container);
+        errno = ENOMEM;
+        return -1;
+    }
+    if (new_container)
+    {
+        container->cid = cid;
+        container->concurrency = 1;
+        container->quantum_ns = 1000000;
+        container->slice_ns = container->quantum_ns;
+        list_init(&container->running_head);
+        list_init(&container->task_head);
+        container->hash_next = usched_table[cid % USCHED_BUCKETS];
+        usched_table[cid % USCHED_BUCKETS] = container;
+        list_add_tail(&container->all, &usched_containers);
+    }
+    task->container = container;
+    task->thread = pthread_self();
+    task->thread_next = usched_self;
+    usched_self = task;
+    container->nr_tasks++;
+    running = task->running = container->nr_running < container->concurrency;
+    if (running)
+    {
+        list_add_tail(&task->list, &container->running_head);
+        container->nr_running++;
+        task->exec_mark = thread_cpu_ns();
+    }
+    else
+        list_add_tail(&task->list, &container->task_head);
+    container_update_timers(container);
+    pthread_mutex_unlock(&usched_lock);
+    if (!running)
+        task_park(task);
+    return PCONTAINER_NO_SLOT;
+}
+
+/**
+ * Leave container cid, handing the caller's slot on, and free the container
+ * once nobody is left in it.
+ */
+static int usched_delete(__u64 cid)
+{
+    struct usched_container *container, **pc;
+    struct usched_task *task, **pt;
+
+    pthread_mutex_lock(&usched_lock);
+    if (!(task = self_find(cid)))
+    {
+        pthread_mutex_unlock(&usched_lock);
+        errno = EINVAL;
+        return -1;
+    }
+    container = task->container;
+    for (pt = &usched_self; *pt != task; pt = &(*pt)->thread_next)
+        ;
+    *pt = task->thread_next;
+    task_account(task);
+    list_del(&task->list);
+    container->nr_tasks--;
+    if (task->running)
+        container->nr_running--;
+    free(task);
+    if (!container->nr_tasks)
+    {
+        for (pc = &usched_table[cid % USCHED_BUCKETS]; *pc != container; pc = &(*pc)->hash_next)
+            ;
+        *pc = container->hash_next;
+        list_del(&container->all);
+        free(container);
+    }
+    else
+        container_run_next(container);
+    pthread_mutex_unlock(&usched_lock);
+    return 0;
+}
+
+/**
+ * Move the caller to the back of the line of the container it is running
+ * in and let the member that waited longest have its slot, if anyone waits.
+ */
+static int usched_switch(void)
+{
+    struct usched_container *container;
+    struct usched_task *task;
+
+    pthread_mutex_lock(&usched_lock);
+    for (task = usched_self; task && !task->running; task = task->thread_next)
+        ;
+    if (!task || !container_oversubscribed(task->container))
+    {
+        if (task)
+            task->expired = 0;
+        pthread_mutex_unlock(&usched_lock);
+        return 0;
+    }
+    container = task->container;
+    task_account(task);
+    container_adapt_slice(container, task);
+    container->switches++;
+    __atomic_store_n(&task->running, 0, __ATOMIC_RELAXED);
+    task->deadline = 0;
+    container->nr_running--;
+    list_del(&task->list);
+    list_add_tail(&task->list, &container->task_head);
+    container_run_next(container);
+    pthread_mutex_unlock(&usched_lock);
+    task_park(task);
+    return 0;
+}
+
+static int usched_set_quantum(__u64 cid, __u64 value)
+{
+    struct usched_container *container;
+    struct usched_list *t;
+
+    pthread_mutex_lock(&usched_lock);
+    if (!(container = container_lookup(cid)))
+    {
+        pthread_mutex_unlock(&usched_lock);
+        errno = EINVAL;
+        return -1;
+    }
+    container->quantum_ns = value;
+    container->slice_ns = value;
+    // restart the current slices with the new length
+    for (t = container->running_head.next; t != &container->running_head; t = t->next)
+        list_task(t)->deadline = 0;
+    container_update_timers(container);
+    pthread_mutex_unlock(&usched_lock);
+    return 0;
+}
+
+static int usched_set_adaptive(__u64 cid, __u64 value)
+{
+    struct usched_container *container;
+
+    pthread_mutex_lock(&usched_lock);
+    if (!(container = container_lookup(cid)))
+    {
+        pthread_mutex_unlock(&usched_lock);
+        errno = EINVAL;
+        return -1;
+    }
+    container->adaptive = value != 0;
+    container->slice_ns = container->quantum_ns;
+    pthread_mutex_unlock(&usched_lock);
+    return 0;
+}
+
+static int usched_set_concurrency(__u64 cid, __u64 value)
+{
+    struct usched_container *container;
+
+    if (!value || value > INT_MAX)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock(&usched_lock);
+    if (!(container = container_lookup(cid)))
+    {
+        pthread_mutex_unlock(&usched_lock);
+        errno = EINVAL;
+        return -1;
+    }
+    container->concurrency = value;
+    container_run_next(container);
+    pthread_mutex_unlock(&usched_lock);
+    return 0;
+}
+
+static int usched_stats(struct processor_container_stats *stats)
+{
+    struct usched_container *container;
+
+    pthread_mutex_lock(&usched_lock);
+    if (!(container = container_lookup(stats->cid)))
+    {
+        pthread_mutex_unlock(&usched_lock);
+        errno = EINVAL;
+        return -1;
+    }
+    stats->nr_tasks = container->nr_tasks;
+    stats->switches = container->switches;
+    stats->wakeups = container->wakeups;
+    stats->runtime_ns = container->runtime_ns;
+    memcpy(stats->latency_hist, container->latency_hist, sizeof(stats->latency_hist));
+    stats->slice_ns = container->slice_ns;
+    pthread_mutex_unlock(&usched_lock);
+    return 0;
+}
+
+/**
+ * Run a command of the kernel module's ioctl interface in user space.
+ * Commands the backend does not implement fail with EOPNOTSUPP.
+ */
+int pcontainer_usched_ioctl(unsigned long request, void *arg)
+{
+    struct processor_container_cmd *cmd = (struct processor_container_cmd *)arg;
+    struct processor_container_param *param = (struct processor_container_param *)arg;
+    int ret;
+
+    if (request == PCONTAINER_IOCTL_CSWITCH && usched_busy)
+    {
+        // from the signal handler, while the thread is in the backend
+        usched_pending = 1;
+        return 0;
+    }
+    usched_busy = 1;
+    switch (request)
+    {
+    case PCONTAINER_IOCTL_CREATE:
+        ret = usched_create(cmd->cid);
+        break;
+    case PCONTAINER_IOCTL_DELETE:
+        ret = usched_delete(cmd->cid);
+        break;
+    case PCONTAINER_IOCTL_CSWITCH:
+        ret = usched_switch();
+        break;
+    case PCONTAINER_IOCTL_SET_QUANTUM:
+        ret = usched_set_quantum(param->cid, param->value);
+        break;
+    case PCONTAINER_IOCTL_SET_ADAPTIVE:
+        ret = usched_set_adaptive(param->cid, param->value);
+        break;
+    case PCONTAINER_IOCTL_SET_CONCURRENCY:
+        ret = usched_set_concurrency(param->cid, param->value);
+        break;
+    case PCONTAINER_IOCTL_STATS:
+        ret = usched_stats((struct processor_container_stats *)arg);
+        break;
+    default:
+        errno = EOPNOTSUPP;
+        ret = -1;
+    }
+    usched_busy = 0;
+    while (usched_pending)
+    {
+        usched_pending = 0;
+        usched_busy = 1;
+        usched_switch();
+        usched_busy = 0;
+    }
+    return ret;
+}
@@ -10,5 +10,11 @@ cd ..
 clear
 sudo insmod kernel_module/processor_container.ko
 sudo chmod 777 /dev/pcontainer
-./benchmark/benchmark "$@"
+# ./test.sh harness [options] runs the benchmark harness instead
+if [ "$1" = "harness" ]; then
+    shift
+    ./benchmark/harness "$@"
+else
+    ./benchmark/benchmark "$@"
+fi
 sudo rmmod processor_container